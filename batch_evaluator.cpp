@@ -0,0 +1,162 @@
+#include "batch_evaluator.hpp"
+#include "jit_compiler.hpp"
+
+// applies an Operator element-wise on a block of rows with the vector kernels of the running CPU,
+// storing the results in lhs
+void apply_operator(Operator op, double* lhs, const double* rhs, std::size_t count, PowMode pow_mode) {
+    const SimdKernels& kernels = simd_kernels();
+
+    switch(op) {
+        case Operator::Addition:
+            kernels.add(lhs, rhs, count);
+            break;
+        case Operator::Subtraction:
+            kernels.subtract(lhs, rhs, count);
+            break;
+        case Operator::Multiplication:
+            kernels.multiply(lhs, rhs, count);
+            break;
+        case Operator::Division:
+            if (!kernels.divide(lhs, rhs, count))
+                throw EvaluationError({EvalErrorCode::DivisionByZero});
+            break;
+        case Operator::Exponentiation:
+            if (pow_mode == PowMode::Approximate) {
+                kernels.pow_approximate(lhs, rhs, count);
+            } else {
+                kernels.pow_exact(lhs, rhs, count);
+            }
+            break;
+        default:
+            throw std::runtime_error("Invalid Operator enum value");
+    }
+}
+
+namespace {
+
+// applies a function on a block of rows, its arguments are the blocks on top of the stack and the result
+// replaces them, functions without a block version are called once per row
+void apply_function(const FunctionDefinition& function, double* stack, std::size_t& top, std::size_t count) {
+    top -= function.arity;
+    double* const arguments = &stack[top++ * batch_block_size];
+    if (function.batch != nullptr) {
+        function.batch(arguments, batch_block_size, count);
+        return;
+    }
+    std::array<double, max_function_arity> row{};
+    for (std::size_t i = 0; i < count; ++i) {
+        for (std::size_t k = 0; k < function.arity; ++k) {
+            row[k] = arguments[k * batch_block_size + i];
+        }
+        arguments[i] = function.scalar(row.data());
+    }
+}
+
+// runs instructions on one block of count rows starting at first_row, block operands are batch_block_size apart
+// on the stack, the result is left in the first block
+void run_block(std::span<const Instruction> program, std::span<const double* const> columns, std::size_t first_row,
+               std::size_t count, double* stack, PowMode pow_mode) {
+    std::size_t top = 0;
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+                std::fill_n(&stack[top++ * batch_block_size], count, instruction.value);
+                break;
+            case Instruction::Type::Variable:
+                std::copy_n(columns[instruction.slot] + first_row, count, &stack[top++ * batch_block_size]);
+                break;
+            case Instruction::Type::Operator:
+                --top;
+                apply_operator(instruction.op, &stack[(top - 1) * batch_block_size], &stack[top * batch_block_size], count, pow_mode);
+                break;
+            case Instruction::Type::Call:
+                apply_function(function_definition(instruction.slot), stack, top, count);
+                break;
+            case Instruction::Type::Store:
+                std::copy_n(&stack[(top - 1) * batch_block_size], count, &stack[instruction.slot * batch_block_size]);
+                break;
+            case Instruction::Type::Load:
+                std::copy_n(&stack[instruction.slot * batch_block_size], count, &stack[top++ * batch_block_size]);
+                break;
+        }
+    }
+}
+
+} // namespace
+
+// evaluates a compiled expression once per row of the output column, one block of rows at a time
+void evaluate_batch(const CompiledExpression& expression, std::span<const double* const> columns, std::span<double> output,
+                    PowMode pow_mode) {
+    if (columns.size() < expression.variables().size()) {
+        throw EvaluationError({EvalErrorCode::NotEnoughBindings});
+    }
+    record(Metric::Evaluations);
+    record(Metric::BatchRows, output.size());
+    record_max(Metric::MaxStackDepth, expression.max_stack_depth());
+    const PhaseTimer timer(Metric::EvaluateNanoseconds);
+
+    // native code calls std::pow, so it only stands in for the kernels when they would do the same
+    const bool exact = pow_mode == PowMode::Exact ||
+                       std::ranges::none_of(expression.program(), [](const Instruction& instruction) {
+                           return instruction.type == Instruction::Type::Operator && instruction.op == Operator::Exponentiation;
+                       });
+    if (const JitFunction* native = exact ? expression.native_code(output.size()) : nullptr) {
+        if (const auto result = native->eval_batch(columns, output); !result) {
+            throw EvaluationError(result.error());
+        }
+        return;
+    }
+
+    // every stack entry holds a whole block of rows, the per thread stack only grows
+    thread_local std::vector<double> stack;
+    if (stack.size() < expression.max_stack_depth() * batch_block_size) {
+        stack.resize(expression.max_stack_depth() * batch_block_size);
+    }
+
+    for (std::size_t first_row = 0; first_row < output.size(); first_row += batch_block_size) {
+        const std::size_t count = std::min(batch_block_size, output.size() - first_row);
+        run_block(expression.program(), columns, first_row, count, stack.data(), pow_mode);
+        std::copy_n(stack.begin(), count, output.begin() + static_cast<std::ptrdiff_t>(first_row));
+    }
+}
+
+// evaluates fused expressions once per row, every block of rows runs all segments before moving on,
+// so each input column is only swept once
+void evaluate_batch(const FusedProgram& program, std::span<const double* const> columns, std::span<double* const> outputs,
+                    std::size_t rows, PowMode pow_mode) {
+    if (columns.size() < program.variables().size() || outputs.size() < program.expression_count()) {
+        throw EvaluationError({EvalErrorCode::NotEnoughBindings});
+    }
+    record(Metric::Evaluations);
+    record(Metric::BatchRows, rows);
+    record_max(Metric::MaxStackDepth, program.max_stack_depth());
+    const PhaseTimer timer(Metric::EvaluateNanoseconds);
+
+    const bool exact = pow_mode == PowMode::Exact ||
+                       std::ranges::none_of(program.program(), [](const Instruction& instruction) {
+                           return instruction.type == Instruction::Type::Operator && instruction.op == Operator::Exponentiation;
+                       });
+    if (const FusedJitFunction* native = exact ? program.native_code() : nullptr) {
+        if (const auto result = native->eval_batch(program, columns, outputs, rows); !result) {
+            throw EvaluationError(result.error());
+        }
+        return;
+    }
+
+    thread_local std::vector<double> stack;
+    if (stack.size() < program.max_stack_depth() * batch_block_size) {
+        stack.resize(program.max_stack_depth() * batch_block_size);
+    }
+
+    const std::span<const Instruction> instructions = program.program();
+    for (std::size_t first_row = 0; first_row < rows; first_row += batch_block_size) {
+        const std::size_t count = std::min(batch_block_size, rows - first_row);
+        std::size_t begin = 0;
+        for (std::size_t i = 0; i < program.expression_count(); ++i) {
+            const std::size_t end = program.segment_ends()[i];
+            run_block(instructions.subspan(begin, end - begin), columns, first_row, count, stack.data(), pow_mode);
+            std::copy_n(stack.begin(), count, outputs[i] + first_row);
+            begin = end;
+        }
+    }
+}
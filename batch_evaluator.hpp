@@ -0,0 +1,27 @@
+#ifndef BATCH_EVALUATOR_HPP
+#define BATCH_EVALUATOR_HPP
+
+#include "expression_evaluator.hpp"
+#include "fused_program.hpp"
+#include "simd_kernels.hpp"
+
+#include <span>
+
+// number of rows every instruction is applied to before moving on to the next one
+constexpr std::size_t batch_block_size = 256;
+
+// applies an Operator element-wise on a block of rows with the vector kernels of the running CPU,
+// storing the results in lhs
+void apply_operator(Operator op, double* lhs, const double* rhs, std::size_t count, PowMode pow_mode = PowMode::Exact);
+
+// evaluates a compiled expression once per row of the output column,
+// columns[slot] points at one contiguous array of values per variable with at least output.size() rows
+void evaluate_batch(const CompiledExpression& expression, std::span<const double* const> columns, std::span<double> output,
+                    PowMode pow_mode = PowMode::Exact);
+
+// evaluates fused expressions once per row in a single pass over the columns, outputs[i] receives rows results
+// of expression i, columns[slot] points at one contiguous array of values per variable with at least rows rows
+void evaluate_batch(const FusedProgram& program, std::span<const double* const> columns, std::span<double* const> outputs,
+                    std::size_t rows, PowMode pow_mode = PowMode::Exact);
+
+#endif //BATCH_EVALUATOR_HPP
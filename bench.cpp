@@ -0,0 +1,258 @@
+#include "batch_evaluator.hpp"
+#include "evaluation_service.hpp"
+#include "expression_cache.hpp"
+#include "expression_evaluator.hpp"
+#include "register_vm.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+namespace {
+
+// "((...(1+1)+1)...+1)" with depth levels of parentheses
+std::string nested_expression(std::size_t depth) {
+    std::string expression(depth, '(');
+    expression += "1";
+    for (std::size_t i = 0; i < depth; ++i) {
+        expression += "+1)";
+    }
+    return expression;
+}
+
+// "1+2*3-4/5+..." with length operands
+std::string flat_expression(std::size_t length) {
+    static constexpr char operators[] = {'+', '*', '-', '/'};
+    std::string expression = "1";
+    for (std::size_t i = 1; i < length; ++i) {
+        expression += operators[i % 4];
+        expression += std::to_string(i % 9 + 1);
+    }
+    return expression;
+}
+
+// "1,01^1,01^..." with length operands, evaluated right to left
+std::string exponent_expression(std::size_t length) {
+    std::string expression = "1,01";
+    for (std::size_t i = 1; i < length; ++i) {
+        expression += "^1,01";
+    }
+    return expression;
+}
+
+void set_bytes(benchmark::State& state, const std::string& expression) {
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * expression.size()));
+}
+
+void BM_EvaluateLiteral(benchmark::State& state) {
+    const std::string expression = "12+3*4";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(evaluate(expression));
+    }
+    set_bytes(state, expression);
+}
+BENCHMARK(BM_EvaluateLiteral);
+
+void BM_EvaluateNested(benchmark::State& state) {
+    const std::string expression = nested_expression(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(evaluate(expression));
+    }
+    set_bytes(state, expression);
+}
+BENCHMARK(BM_EvaluateNested)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_EvaluateFlatChain(benchmark::State& state) {
+    const std::string expression = flat_expression(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(evaluate(expression));
+    }
+    set_bytes(state, expression);
+}
+BENCHMARK(BM_EvaluateFlatChain)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_EvaluateExponentChain(benchmark::State& state) {
+    const std::string expression = exponent_expression(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(evaluate(expression));
+    }
+    set_bytes(state, expression);
+}
+BENCHMARK(BM_EvaluateExponentChain)->RangeMultiplier(8)->Range(8, 512);
+
+// compile and evaluation cost of the same expression measured apart
+// both front ends on the same inputs, nested and flat
+void BM_ShuntingYard(benchmark::State& state) {
+    const std::string expression = state.range(1) ? nested_expression(static_cast<std::size_t>(state.range(0)))
+                                                  : flat_expression(static_cast<std::size_t>(state.range(0)));
+    PostfixBuffers buffers;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(infix_to_postfix(expression, buffers));
+    }
+    set_bytes(state, expression);
+}
+BENCHMARK(BM_ShuntingYard)->ArgsProduct({{64, 512, 4096}, {0, 1}});
+
+void BM_Pratt(benchmark::State& state) {
+    const std::string expression = state.range(1) ? nested_expression(static_cast<std::size_t>(state.range(0)))
+                                                  : flat_expression(static_cast<std::size_t>(state.range(0)));
+    PostfixBuffers buffers;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pratt_to_postfix(expression, buffers, static_cast<std::size_t>(state.range(0))));
+    }
+    set_bytes(state, expression);
+}
+BENCHMARK(BM_Pratt)->ArgsProduct({{64, 512, 4096}, {0, 1}});
+
+const std::string split_expression = "(x+1)*(y-2)/(x*y+3)-x^2";
+
+void BM_Compile(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(compile(split_expression));
+    }
+}
+BENCHMARK(BM_Compile);
+
+// steady state, the program is past JitTier::threshold after the first iterations where native code exists
+void BM_EvalCompiled(benchmark::State& state) {
+    const CompiledExpression expression = compile(split_expression);
+    const double bindings[] = {1.5, 2.5};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expression.eval(bindings));
+    }
+}
+BENCHMARK(BM_EvalCompiled);
+
+// the tiers below the native code, on a longer expression with shared subexpressions
+const std::string tier_expression = "(x+1)*(y-2)/(x*y+3)-(x+1)*2+(y-2)/4-x*y*0,5";
+
+void BM_EvalRegisterVm(benchmark::State& state) {
+    const CompiledExpression expression = compile(tier_expression);
+    const RegisterProgram& program = *expression.register_program();
+    const double bindings[] = {1.5, 2.5};
+    std::vector<double> registers(program.register_count());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(program.run(bindings, registers.data()));
+    }
+}
+BENCHMARK(BM_EvalRegisterVm);
+
+void BM_EvalStackInterpreter(benchmark::State& state) {
+    const CompiledExpression expression = compile(tier_expression);
+    const double bindings[] = {1.5, 2.5};
+    std::vector<double> stack(expression.max_stack_depth());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(run_program(expression.program(), bindings, stack.data()));
+    }
+}
+BENCHMARK(BM_EvalStackInterpreter);
+
+// one cache shared by all benchmark threads
+void BM_CacheHit(benchmark::State& state) {
+    static ExpressionCache cache;
+    const std::string expression = flat_expression(16);
+    cache.get(expression);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(evaluate(expression, cache));
+    }
+}
+BENCHMARK(BM_CacheHit)->Threads(1)->Threads(4);
+
+// cycles through more distinct expressions than the cache holds, so every lookup compiles and evicts
+void BM_CacheMiss(benchmark::State& state) {
+    ExpressionCache cache(64, 4);
+    std::vector<std::string> expressions;
+    for (std::size_t i = 0; i < 4096; ++i) {
+        expressions.push_back(std::to_string(i) + "+" + flat_expression(15));
+    }
+    std::size_t next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(evaluate(expressions[next], cache));
+        next = (next + 1) % expressions.size();
+    }
+}
+BENCHMARK(BM_CacheMiss);
+
+// rows per second of a batch evaluation, range(1) selects PowMode
+void BM_Batch(benchmark::State& state) {
+    const auto rows = static_cast<std::size_t>(state.range(0));
+    const auto pow_mode = static_cast<PowMode>(state.range(1));
+    const CompiledExpression expression = compile("(x+1)*(y-2)/(x*y+3)-x^y");
+
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> distribution(0.5, 2.0);
+    std::vector<double> x(rows);
+    std::vector<double> y(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+        x[i] = distribution(random);
+        y[i] = distribution(random);
+    }
+    const double* columns[] = {x.data(), y.data()};
+    std::vector<double> output(rows);
+
+    for (auto _ : state) {
+        evaluate_batch(expression, columns, output, pow_mode);
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * rows));
+}
+BENCHMARK(BM_Batch)->ArgsProduct({{256, 4096, 1 << 20}, {static_cast<long>(PowMode::Exact), static_cast<long>(PowMode::Approximate)}});
+
+// calls with a vector block version against one computed by a libm call per row
+void BM_BatchFunctions(benchmark::State& state) {
+    const auto rows = static_cast<std::size_t>(state.range(0));
+    const CompiledExpression expression = compile(state.range(1) == 0 ? "clamp(sqrt(x)*y;0,8;1,2)+abs(x-y)" : "exp(x)*sin(y)", {}, true);
+
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> distribution(0.5, 2.0);
+    std::vector<double> x(rows);
+    std::vector<double> y(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+        x[i] = distribution(random);
+        y[i] = distribution(random);
+    }
+    const double* columns[] = {x.data(), y.data()};
+    std::vector<double> output(rows);
+
+    for (auto _ : state) {
+        evaluate_batch(expression, columns, output);
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * rows));
+}
+BENCHMARK(BM_BatchFunctions)->ArgsProduct({{4096, 1 << 20}, {0, 1}});
+
+// burst of single row requests for one expression, range(0) is the largest batch they are coalesced into,
+// 1 evaluates every request on its own
+void BM_ServiceBurst(benchmark::State& state) {
+    constexpr std::size_t requests = 4096;
+    static ThreadPool pool(4);
+    EvaluationService service(pool, static_cast<std::size_t>(state.range(0)));
+    const auto expression = std::make_shared<const CompiledExpression>(compile("(x+1)*(y-2)/(x*y+3)-sqrt(x)"));
+
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> distribution(0.5, 2.0);
+    std::vector<double> bindings(2 * requests);
+    for (double& value : bindings) {
+        value = distribution(random);
+    }
+    std::vector<std::future<std::expected<double, EvalError>>> results(requests);
+
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < requests; ++i) {
+            results[i] = service.submit(expression, std::span(bindings).subspan(2 * i, 2));
+        }
+        for (auto& result : results) {
+            benchmark::DoNotOptimize(result.get());
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * requests));
+    state.counters["rows_per_batch"] = static_cast<double>(service.evaluations()) / static_cast<double>(service.batches());
+}
+BENCHMARK(BM_ServiceBurst)->Arg(1)->Arg(64)->Arg(1024)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
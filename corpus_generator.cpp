@@ -0,0 +1,233 @@
+#include "corpus_generator.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+using Random = std::mt19937_64;
+
+constexpr std::array<char, 5> binary_operators{'+', '-', '*', '/', '^'};
+
+// a positive number between 1 and 99, a third of them with decimals
+void append_number(std::string& out, Random& random) {
+    out += std::to_string(1 + random() % 99);
+    if (random() % 3 == 0) {
+        out += ',';
+        out += std::to_string(random() % 1000);
+    }
+}
+
+// up to max_signs unary '+' and '-'
+void append_signs(std::string& out, Random& random, std::size_t max_signs) {
+    for (std::size_t signs = random() % (max_signs + 1); signs > 0; --signs) {
+        out += random() % 2 == 0 ? '-' : '+';
+    }
+}
+
+// a number, most of them plain, the others as the argument of a call
+void append_operand(std::string& out, Random& random) {
+    append_signs(out, random, 1);
+    switch (random() % 8) {
+        case 0:
+            out += "sqrt(";
+            append_number(out, random);
+            out += ')';
+            break;
+        case 1:
+            out += random() % 2 == 0 ? "min(" : "max(";
+            append_number(out, random);
+            out += ';';
+            append_number(out, random);
+            out += ')';
+            break;
+        default:
+            append_number(out, random);
+            break;
+    }
+}
+
+// operands operands split at random points, each side of a split sometimes in parentheses, one split in sixteen
+// is a '^' whose exponent is a single digit from 1 to 3, so powers neither overflow nor underflow and most
+// results are finite
+void append_random(std::string& out, Random& random, std::size_t operands) {
+    if (operands <= 1) {
+        append_operand(out, random);
+        return;
+    }
+    const bool parenthesized = random() % 4 == 0;
+    if (parenthesized) {
+        append_signs(out, random, 1);
+        out += '(';
+    }
+    if (random() % 16 == 0) {
+        // the base in parentheses, so the exponent applies to all of it
+        out += '(';
+        append_random(out, random, operands - 1);
+        out += ")^";
+        out += static_cast<char>('1' + random() % 3);
+    } else {
+        const std::size_t left = 1 + random() % (operands - 1);
+        append_random(out, random, left);
+        out += binary_operators[random() % 4];
+        append_random(out, random, operands - left);
+    }
+    if (parenthesized) {
+        out += ')';
+    }
+}
+
+std::string long_sum(Random& random, std::size_t operands) {
+    std::string out;
+    append_number(out, random);
+    for (std::size_t i = 1; i < operands; ++i) {
+        out += binary_operators[random() % 4];
+        append_number(out, random);
+    }
+    return out;
+}
+
+// alternates plain nesting, ((((1)))), with nesting around operators, (1+(2*(3-4)))
+std::string deep_parentheses(Random& random, std::size_t levels, bool with_operators) {
+    std::string out;
+    for (std::size_t i = 0; i < levels; ++i) {
+        if (with_operators) {
+            append_number(out, random);
+            out += binary_operators[random() % 3];
+        }
+        out += '(';
+    }
+    append_number(out, random);
+    out.append(levels, ')');
+    return out;
+}
+
+// bases just above 1 keep 1,0001^1,0002^... finite however long the chain is
+std::string power_chain(Random& random, std::size_t operands) {
+    std::string out;
+    for (std::size_t i = 0; i < operands; ++i) {
+        out += i == 0 ? "" : "^";
+        out += "1,000";
+        out += std::to_string(1 + random() % 9);
+    }
+    return out;
+}
+
+// every operand and every eighth group behind up to eight unary signs, like --+-2*-(+-3-+--4)
+std::string unary_chain(Random& random, std::size_t operands) {
+    std::string out;
+    std::size_t open = 0;
+    for (std::size_t i = 0; i < operands; ++i) {
+        if (i > 0) {
+            out += binary_operators[random() % 3];
+        }
+        append_signs(out, random, 8);
+        if (i % 8 == 0 && i + 1 < operands) {
+            out += '(';
+            append_signs(out, random, 8);
+            ++open;
+        }
+        append_number(out, random);
+    }
+    out.append(open, ')');
+    return out;
+}
+
+// calls nested levels deep, sqrt(abs(max(1;clamp(2;0,5;99)))), the text after the innermost argument closes
+// the calls in reverse order
+std::string nested_calls(Random& random, std::size_t levels) {
+    std::string out;
+    std::vector<std::string_view> closings;
+    closings.reserve(levels);
+    for (std::size_t i = 0; i < levels; ++i) {
+        switch (random() % 4) {
+            case 0:
+                out += "sqrt(";
+                closings.push_back(")");
+                break;
+            case 1:
+                out += "abs(";
+                closings.push_back(")");
+                break;
+            case 2:
+                out += "max(";
+                append_number(out, random);
+                out += ';';
+                closings.push_back(")");
+                break;
+            default:
+                out += "clamp(";
+                closings.push_back(";0,5;99)");
+                break;
+        }
+    }
+    append_number(out, random);
+    for (auto closing = closings.rbegin(); closing != closings.rend(); ++closing) {
+        out += *closing;
+    }
+    return out;
+}
+
+} // namespace
+
+const char* corpus_category_name(CorpusCategory category) {
+    switch (category) {
+        case CorpusCategory::Random:
+            return "random";
+        case CorpusCategory::LongSum:
+            return "long_sum";
+        case CorpusCategory::DeepParentheses:
+            return "deep_parentheses";
+        case CorpusCategory::PowerChain:
+            return "power_chain";
+        case CorpusCategory::UnaryChain:
+            return "unary_chain";
+        case CorpusCategory::NestedCalls:
+            return "nested_calls";
+    }
+    return "unknown";
+}
+
+// returns the category with the given name
+std::optional<CorpusCategory> find_corpus_category(std::string_view name) {
+    for (const CorpusCategory category : corpus_categories) {
+        if (name == corpus_category_name(category)) {
+            return category;
+        }
+    }
+    return std::nullopt;
+}
+
+// generates well-formed expressions of a category, the seed is mixed with the category so each has its own sequence
+std::vector<std::string> generate_corpus(CorpusCategory category, const CorpusOptions& options) {
+    Random random(options.seed ^ (static_cast<std::uint64_t>(category) * 0x9e3779b97f4a7c15));
+    const std::size_t complexity = std::max<std::size_t>(options.complexity, 1);
+    std::vector<std::string> corpus;
+    corpus.reserve(options.expressions);
+    for (std::size_t i = 0; i < options.expressions; ++i) {
+        switch (category) {
+            case CorpusCategory::Random: {
+                std::string expression;
+                append_random(expression, random, 1 + random() % complexity);
+                corpus.push_back(std::move(expression));
+                break;
+            }
+            case CorpusCategory::LongSum:
+                corpus.push_back(long_sum(random, complexity));
+                break;
+            case CorpusCategory::DeepParentheses:
+                corpus.push_back(deep_parentheses(random, complexity, i % 2 == 1));
+                break;
+            case CorpusCategory::PowerChain:
+                corpus.push_back(power_chain(random, complexity));
+                break;
+            case CorpusCategory::UnaryChain:
+                corpus.push_back(unary_chain(random, complexity));
+                break;
+            case CorpusCategory::NestedCalls:
+                corpus.push_back(nested_calls(random, complexity));
+                break;
+        }
+    }
+    return corpus;
+}
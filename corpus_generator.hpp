@@ -0,0 +1,41 @@
+#ifndef CORPUS_GENERATOR_HPP
+#define CORPUS_GENERATOR_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// kinds of generated expressions, the adversarial ones stress a single part of the parser
+enum class CorpusCategory {
+    Random, // mixed operators, unary signs, parentheses and calls with random shape
+    LongSum, // one flat chain of left associative operators
+    DeepParentheses, // parentheses nested complexity levels deep
+    PowerChain, // right associative '^' chained complexity times, each '^' stays on the operator stack
+    UnaryChain, // runs of unary signs before operands and parentheses
+    NestedCalls, // function calls nested complexity levels deep
+};
+
+constexpr std::array<CorpusCategory, 6> corpus_categories{
+        CorpusCategory::Random, CorpusCategory::LongSum, CorpusCategory::DeepParentheses,
+        CorpusCategory::PowerChain, CorpusCategory::UnaryChain, CorpusCategory::NestedCalls,
+};
+
+// size and seed of a corpus, the same options always generate the same corpus
+struct CorpusOptions {
+    std::size_t expressions = 2000;
+    std::size_t complexity = 256; // operands, or nesting levels for the nested categories
+    std::uint64_t seed = 42;
+};
+
+const char* corpus_category_name(CorpusCategory category);
+
+// returns the category with the given name
+std::optional<CorpusCategory> find_corpus_category(std::string_view name);
+
+// generates well-formed expressions of a category in the syntax of evaluate(), numbers use ',' as the decimal point
+std::vector<std::string> generate_corpus(CorpusCategory category, const CorpusOptions& options);
+
+#endif //CORPUS_GENERATOR_HPP
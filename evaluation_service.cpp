@@ -0,0 +1,120 @@
+#include "evaluation_service.hpp"
+#include "batch_evaluator.hpp"
+
+// runs batches on pool, which must outlive the service
+EvaluationService::EvaluationService(ThreadPool& pool, std::size_t max_batch_rows)
+        : pool_(pool), max_batch_rows_(std::max<std::size_t>(max_batch_rows, 1)) {
+}
+
+// waits until every submitted evaluation has completed, must not run on a task of the pool
+EvaluationService::~EvaluationService() {
+    std::unique_lock lock(mutex_);
+    idle_.wait(lock, [this] { return queued_ == 0; });
+}
+
+// queues an evaluation, joining the open batch of the expression or opening one and queueing its task
+std::future<std::expected<double, EvalError>> EvaluationService::submit(std::shared_ptr<const CompiledExpression> expression,
+                                                                        std::span<const double> bindings) {
+    std::promise<std::expected<double, EvalError>> result;
+    auto future = result.get_future();
+    const std::size_t variable_count = expression->variables().size();
+    if (bindings.size() < variable_count) {
+        result.set_value(std::unexpected(EvalError{EvalErrorCode::NotEnoughBindings}));
+        return future;
+    }
+
+    std::shared_ptr<Batch> opened;
+    {
+        std::lock_guard lock(mutex_);
+        std::shared_ptr<Batch>& batch = open_[expression.get()];
+        if (!batch) {
+            batch = std::make_shared<Batch>();
+            batch->expression = std::move(expression);
+            opened = batch;
+            ++queued_;
+        }
+        batch->bindings.insert(batch->bindings.end(), bindings.begin(), bindings.begin() + static_cast<std::ptrdiff_t>(variable_count));
+        batch->results.push_back(std::move(result));
+        // full batches stop taking rows, their task is already queued
+        if (batch->results.size() >= max_batch_rows_) {
+            open_.erase(batch->expression.get());
+        }
+    }
+    if (opened) {
+        pool_.submit([this, opened = std::move(opened)] { run(opened); });
+    }
+    return future;
+}
+
+// closes a batch to further submissions, evaluates it and completes its callers, rows are only appended
+// while the batch is open and under the lock, so after closing it the task owns them
+void EvaluationService::run(const std::shared_ptr<Batch>& batch) {
+    {
+        std::lock_guard lock(mutex_);
+        if (const auto it = open_.find(batch->expression.get()); it != open_.end() && it->second == batch) {
+            open_.erase(it);
+        }
+    }
+
+    const CompiledExpression& expression = *batch->expression;
+    const std::size_t rows = batch->results.size();
+    const std::size_t variable_count = expression.variables().size();
+    try {
+        if (rows == 1) {
+            batch->results[0].set_value(expression.try_eval(batch->bindings));
+        } else {
+            // the batch evaluator reads one contiguous column per variable, the per thread buffers only grow
+            thread_local std::vector<double> values;
+            thread_local std::vector<const double*> columns;
+            thread_local std::vector<double> output;
+            values.resize(rows * variable_count);
+            columns.resize(variable_count);
+            output.resize(rows);
+            for (std::size_t slot = 0; slot < variable_count; ++slot) {
+                columns[slot] = &values[slot * rows];
+                for (std::size_t row = 0; row < rows; ++row) {
+                    values[slot * rows + row] = batch->bindings[row * variable_count + slot];
+                }
+            }
+
+            bool evaluated = true;
+            try {
+                evaluate_batch(expression, columns, output);
+            } catch (const EvaluationError&) {
+                evaluated = false;
+            }
+            for (std::size_t row = 0; row < rows; ++row) {
+                // a failed batch is evaluated again row by row, so only the rows dividing by zero fail
+                batch->results[row].set_value(evaluated ? std::expected<double, EvalError>(output[row])
+                                                        : expression.try_eval(std::span(batch->bindings).subspan(row * variable_count, variable_count)));
+            }
+        }
+    } catch (...) {
+        for (auto& result : batch->results) {
+            try {
+                result.set_exception(std::current_exception());
+            } catch (const std::future_error&) {
+                // already satisfied
+            }
+        }
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        ++batches_;
+        evaluations_ += rows;
+        // notified under the lock, the destructor may destroy idle_ as soon as it sees queued_ == 0
+        --queued_;
+        idle_.notify_all();
+    }
+}
+
+std::size_t EvaluationService::batches() const {
+    std::lock_guard lock(mutex_);
+    return batches_;
+}
+
+std::size_t EvaluationService::evaluations() const {
+    std::lock_guard lock(mutex_);
+    return evaluations_;
+}
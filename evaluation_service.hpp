@@ -0,0 +1,67 @@
+#ifndef EVALUATION_SERVICE_HPP
+#define EVALUATION_SERVICE_HPP
+
+#include "expression_evaluator.hpp"
+#include "thread_pool.hpp"
+
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// asynchronous front of the evaluator for request handlers, evaluations of the same compiled expression
+// submitted while the pool is busy are coalesced into one batch and run on the batch evaluator
+//
+// the first submission for an expression opens a batch and queues a pool task for it, later submissions join
+// the open batch until the task starts or the batch holds max_batch_rows rows, so an idle service adds no
+// latency and batches grow with the load. Every caller gets its own result, a division by zero in one row
+// only fails that row. Thread safe.
+class EvaluationService {
+public:
+    // default number of rows after which a batch is closed and the next submission opens another one
+    static constexpr std::size_t default_max_batch_rows = 1024;
+
+    // runs batches on pool, which must outlive the service
+    explicit EvaluationService(ThreadPool& pool, std::size_t max_batch_rows = default_max_batch_rows);
+
+    // waits until every submitted evaluation has completed
+    ~EvaluationService();
+
+    EvaluationService(const EvaluationService&) = delete;
+    EvaluationService& operator=(const EvaluationService&) = delete;
+
+    // queues an evaluation with bindings[slot] as the value of each variable, bindings are copied, the
+    // future holds the result or the error of this evaluation, e.g. from ExpressionCache::get()
+    std::future<std::expected<double, EvalError>> submit(std::shared_ptr<const CompiledExpression> expression,
+                                                         std::span<const double> bindings = {});
+
+    // batches run so far and the evaluations they held, to check how well requests are coalesced
+    std::size_t batches() const;
+    std::size_t evaluations() const;
+
+private:
+    // evaluations of one expression collected while their pool task is queued
+    struct Batch {
+        std::shared_ptr<const CompiledExpression> expression;
+        std::vector<double> bindings; // variables().size() values per row, row after row
+        std::vector<std::promise<std::expected<double, EvalError>>> results;
+    };
+
+    // closes a batch to further submissions, evaluates it and completes its callers
+    void run(const std::shared_ptr<Batch>& batch);
+
+    ThreadPool& pool_;
+    std::size_t max_batch_rows_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::unordered_map<const CompiledExpression*, std::shared_ptr<Batch>> open_; // batches still taking rows
+    std::size_t queued_ = 0; // batches whose task has not finished
+    std::size_t batches_ = 0;
+    std::size_t evaluations_ = 0;
+};
+
+#endif //EVALUATION_SERVICE_HPP
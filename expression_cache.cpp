@@ -0,0 +1,180 @@
+#include "expression_cache.hpp"
+
+#include <bit>
+#include <mutex>
+
+namespace {
+
+// checks whether character belongs to a number or variable name, where whitespace is significant
+bool is_operand_text(char c) {
+    return is_operand_char(c) || c == '.' || c == ',';
+}
+
+} // namespace
+
+// removes whitespace that does not separate two operands, so equivalent spellings share a cache entry
+std::string normalize_expression(std::string_view expression) {
+    std::string normalized;
+    normalized.reserve(expression.size());
+
+    bool pending_space = false;
+    for (const char c : expression) {
+        if (c == ' ') {
+            pending_space = true;
+            continue;
+        }
+        // "1 2" and "12" differ, so one space is kept between operand characters
+        if (pending_space && !normalized.empty() && is_operand_text(normalized.back()) && is_operand_text(c)) {
+            normalized += ' ';
+        }
+        pending_space = false;
+        normalized += c;
+    }
+    return normalized;
+}
+
+ExpressionCache::ExpressionCache(std::size_t capacity, std::size_t shard_count)
+        : shards_(std::bit_ceil(std::max<std::size_t>(shard_count, 1))) {
+    capacity = std::max(capacity, shards_.size());
+    shard_capacity_ = (capacity + shards_.size() - 1) / shards_.size();
+    for (Shard& shard : shards_) {
+        shard.entries = std::vector<Entry>(shard_capacity_);
+        shard.index.reserve(shard_capacity_);
+    }
+}
+
+// returns the compiled program of an expression, compiling and caching it on a miss
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(std::string_view expression) {
+    auto program = try_get(expression);
+    if (!program) {
+        throw EvaluationError(program.error(), expression);
+    }
+    return std::move(*program);
+}
+
+// returns the compiled program of an expression without throwing, malformed expressions are not cached
+std::expected<std::shared_ptr<const CompiledExpression>, EvalError> ExpressionCache::try_get(std::string_view expression) {
+    thread_local std::string normalized; // reused buffer for keys of expressions containing whitespace
+    std::string_view key = expression;
+    if (expression.find(' ') != std::string::npos) {
+        normalized = normalize_expression(expression);
+        key = normalized;
+    }
+
+    // shard by the high hash bits, the index of each shard uses the low ones
+    const std::size_t hash = KeyHash()(key);
+    Shard& shard = shards_[(hash >> 32) & (shards_.size() - 1)];
+
+    if (auto program = find(shard, key)) {
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        record(Metric::CacheHits);
+        return program;
+    }
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    record(Metric::CacheMisses);
+
+    // compile outside of the lock, the original text is used so error positions refer to what the caller passed
+    auto compiled = try_compile(expression);
+    if (!compiled) {
+        return std::unexpected(compiled.error());
+    }
+    return insert(shard, key, std::make_shared<const CompiledExpression>(std::move(*compiled)));
+}
+
+// looks a key up holding the shard lock in shared mode
+std::shared_ptr<const CompiledExpression> ExpressionCache::find(Shard& shard, std::string_view key) {
+    std::shared_lock lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        return nullptr;
+    }
+
+    Entry& entry = shard.entries[it->second];
+    if (!entry.referenced.load(std::memory_order_relaxed)) {
+        entry.referenced.store(true, std::memory_order_relaxed);
+    }
+    return entry.program;
+}
+
+// stores a new entry unless another thread already did, evicting with the clock hand when full
+std::shared_ptr<const CompiledExpression> ExpressionCache::insert(Shard& shard, std::string_view key,
+                                                                  std::shared_ptr<const CompiledExpression> program) {
+    std::unique_lock lock(shard.mutex);
+    if (const auto it = shard.index.find(key); it != shard.index.end()) {
+        return shard.entries[it->second].program;
+    }
+
+    std::size_t slot = shard.size;
+    if (shard.size < shard.entries.size()) {
+        ++shard.size;
+    } else {
+        // every referenced entry met by the hand gets a second chance
+        while (shard.entries[shard.hand].referenced.load(std::memory_order_relaxed)) {
+            shard.entries[shard.hand].referenced.store(false, std::memory_order_relaxed);
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+        }
+        slot = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+        shard.index.erase(shard.entries[slot].key);
+    }
+
+    Entry& entry = shard.entries[slot];
+    entry.key = key;
+    entry.program = std::move(program);
+    entry.referenced.store(false, std::memory_order_relaxed);
+    shard.index.emplace(entry.key, slot);
+    return entry.program;
+}
+
+// drops all entries, counters are kept
+void ExpressionCache::clear() {
+    for (Shard& shard : shards_) {
+        std::unique_lock lock(shard.mutex);
+        for (std::size_t i = 0; i < shard.size; ++i) {
+            shard.entries[i].key.clear();
+            shard.entries[i].program.reset();
+        }
+        shard.index.clear();
+        shard.size = 0;
+        shard.hand = 0;
+    }
+}
+
+std::size_t ExpressionCache::size() const {
+    std::size_t size = 0;
+    for (const Shard& shard : shards_) {
+        std::shared_lock lock(shard.mutex);
+        size += shard.size;
+    }
+    return size;
+}
+
+std::size_t ExpressionCache::hits() const {
+    std::size_t hits = 0;
+    for (const Shard& shard : shards_) {
+        hits += shard.hits.load(std::memory_order_relaxed);
+    }
+    return hits;
+}
+
+std::size_t ExpressionCache::misses() const {
+    std::size_t misses = 0;
+    for (const Shard& shard : shards_) {
+        misses += shard.misses.load(std::memory_order_relaxed);
+    }
+    return misses;
+}
+
+// evaluates an expression, compiling it only if the cache does not already hold it
+double evaluate(std::string_view expression, ExpressionCache& cache) {
+    return cache.get(expression)->eval();
+}
+
+// evaluates an expression without throwing, compiling it only if the cache does not already hold it
+std::expected<double, EvalError> try_evaluate(std::string_view expression, ExpressionCache& cache) {
+    const auto program = cache.try_get(expression);
+    if (!program) {
+        return std::unexpected(program.error());
+    }
+    return (*program)->try_eval();
+}
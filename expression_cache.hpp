@@ -0,0 +1,82 @@
+#ifndef EXPRESSION_CACHE_HPP
+#define EXPRESSION_CACHE_HPP
+
+#include "expression_evaluator.hpp"
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// removes whitespace that does not separate two operands, so equivalent spellings share a cache entry
+std::string normalize_expression(std::string_view expression);
+
+// bounded map from expression text to its compiled program, evicting entries with the CLOCK algorithm
+//
+// safe to use from any number of threads: keys are spread over independently locked shards, a hit only takes
+// its shard's lock in shared mode and marks the entry with an atomic flag, so concurrent lookups never serialize
+// on a common mutex. Programs are handed out as shared pointers to immutable CompiledExpression objects, an
+// evicted program stays alive until the last thread using it drops its pointer.
+class ExpressionCache {
+public:
+    explicit ExpressionCache(std::size_t capacity = 1024, std::size_t shard_count = 16);
+
+    // returns the compiled program of an expression, compiling and caching it on a miss
+    std::shared_ptr<const CompiledExpression> get(std::string_view expression);
+
+    // returns the compiled program of an expression without throwing, malformed expressions are not cached
+    std::expected<std::shared_ptr<const CompiledExpression>, EvalError> try_get(std::string_view expression);
+
+    // drops all entries, counters are kept
+    void clear();
+
+    std::size_t size() const;
+    std::size_t capacity() const { return shards_.size() * shard_capacity_; }
+    std::size_t hits() const;
+    std::size_t misses() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CompiledExpression> program;
+        std::atomic<bool> referenced = false;
+    };
+
+    // hashes std::string and std::string_view alike so lookups do not need to build a key
+    struct KeyHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const { return std::hash<std::string_view>()(key); }
+    };
+
+    // independently locked part of the cache, aligned so shards do not share cache lines
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<Entry> entries; // allocated once, the first `size` are in use
+        std::size_t size = 0;
+        std::unordered_map<std::string, std::size_t, KeyHash, std::equal_to<>> index;
+        std::size_t hand = 0;
+        std::atomic<std::size_t> hits = 0;
+        std::atomic<std::size_t> misses = 0;
+    };
+
+    // looks a key up holding the shard lock in shared mode
+    static std::shared_ptr<const CompiledExpression> find(Shard& shard, std::string_view key);
+
+    // stores a new entry unless another thread already did, evicting with the clock hand when full,
+    // returns the program now cached under the key
+    std::shared_ptr<const CompiledExpression> insert(Shard& shard, std::string_view key, std::shared_ptr<const CompiledExpression> program);
+
+    std::size_t shard_capacity_;
+    std::vector<Shard> shards_;
+};
+
+// evaluates an expression, compiling it only if the cache does not already hold it
+double evaluate(std::string_view expression, ExpressionCache& cache);
+
+// evaluates an expression without throwing, compiling it only if the cache does not already hold it
+std::expected<double, EvalError> try_evaluate(std::string_view expression, ExpressionCache& cache);
+
+#endif //EXPRESSION_CACHE_HPP
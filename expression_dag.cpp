@@ -0,0 +1,228 @@
+#include "expression_dag.hpp"
+
+#include <bit>
+
+std::size_t ExpressionDag::NodeKeyHash::operator()(const NodeKey& key) const {
+    std::size_t hash = std::hash<std::uint64_t>()(key.value);
+    const auto combine = [&hash](std::size_t part) {
+        hash ^= part + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    };
+    combine(static_cast<std::size_t>(key.type));
+    combine(static_cast<std::size_t>(key.op));
+    for (const std::uint32_t operand : key.operands) {
+        combine(operand);
+    }
+    return hash;
+}
+
+ExpressionDag::ExpressionDag(std::pmr::memory_resource* resource) : nodes_(resource), index_(resource) {
+}
+
+// builds the graph of a postfix program, returns an error if it is malformed or already uses temporaries
+std::expected<ExpressionDag, EvalError> ExpressionDag::build(std::span<const Instruction> program, std::pmr::memory_resource* resource) {
+    ExpressionDag dag(resource);
+    dag.nodes_.reserve(program.size());
+    dag.index_.reserve(program.size());
+
+    std::pmr::vector<std::uint32_t> operands(resource);
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+                operands.push_back(dag.add_number(instruction.value));
+                break;
+            case Instruction::Type::Variable:
+                operands.push_back(dag.add_variable(instruction.slot));
+                break;
+            case Instruction::Type::Operator: {
+                if (operands.size() < 2) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands});
+                }
+                const std::uint32_t rhs = operands.back();
+                operands.pop_back();
+                operands.back() = dag.add_operator(instruction.op, operands.back(), rhs);
+                break;
+            }
+            case Instruction::Type::Call: {
+                if (instruction.slot >= function_count()) {
+                    return std::unexpected(EvalError{EvalErrorCode::UnknownFunction});
+                }
+                const std::size_t arity = function_definition(instruction.slot).arity;
+                if (operands.size() < arity) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands});
+                }
+                const std::uint32_t call = dag.add_call(instruction.slot, std::span(operands).last(arity));
+                operands.resize(operands.size() - arity);
+                operands.push_back(call);
+                break;
+            }
+            case Instruction::Type::Store:
+            case Instruction::Type::Load:
+                return std::unexpected(EvalError{EvalErrorCode::InvalidTemporarySlot});
+        }
+    }
+
+    if (operands.size() != 1) {
+        return std::unexpected(EvalError{operands.empty() ? EvalErrorCode::EmptyExpression : EvalErrorCode::TooManyOperands});
+    }
+    dag.root_ = operands.back();
+    ++dag.nodes_[dag.root_].uses;
+    return dag;
+}
+
+// returns the node pushing a number, numbers are told apart by their bits so 0 and -0 stay distinct
+std::uint32_t ExpressionDag::add_number(double value) {
+    DagNode node{Instruction::Type::Number};
+    node.value = value;
+    return intern({Instruction::Type::Number, {}, std::bit_cast<std::uint64_t>(value), {}}, node);
+}
+
+// returns the node reading a variable slot, creating it unless an identical one exists
+std::uint32_t ExpressionDag::add_variable(std::size_t slot) {
+    DagNode node{Instruction::Type::Variable};
+    node.slot = slot;
+    return intern({Instruction::Type::Variable, {}, slot, {}}, node);
+}
+
+// returns the node applying an operator, creating it unless an identical one exists
+std::uint32_t ExpressionDag::add_operator(Operator op, std::uint32_t lhs, std::uint32_t rhs) {
+    // IEEE addition and multiplication are commutative, so a+b and b+a share a node
+    const bool commutative = op == Operator::Addition || op == Operator::Multiplication;
+    const NodeKey key{Instruction::Type::Operator, op, 0, {commutative ? std::min(lhs, rhs) : lhs, commutative ? std::max(lhs, rhs) : rhs}};
+
+    DagNode node{Instruction::Type::Operator};
+    node.op = op;
+    node.operands = {lhs, rhs};
+    node.operand_count = 2;
+    return intern(key, node);
+}
+
+// returns the node calling a function, functions are pure so equal calls share a node
+std::uint32_t ExpressionDag::add_call(std::size_t function, std::span<const std::uint32_t> arguments) {
+    DagNode node{Instruction::Type::Call};
+    node.slot = function;
+    std::ranges::copy(arguments, node.operands.begin());
+    node.operand_count = static_cast<std::uint32_t>(arguments.size());
+    return intern({Instruction::Type::Call, {}, function, node.operands}, node);
+}
+
+std::uint32_t ExpressionDag::intern(const NodeKey& key, const DagNode& node) {
+    const auto [it, inserted] = index_.try_emplace(key, static_cast<std::uint32_t>(nodes_.size()));
+    if (inserted) {
+        nodes_.push_back(node);
+        for (std::uint32_t i = 0; i < node.operand_count; ++i) {
+            ++nodes_[node.operands[i]].uses;
+        }
+    }
+    return it->second;
+}
+
+// emits a postfix program computing every shared subexpression once, keeping its value in a temporary
+// stack slot above the operands until its last use, slots of dead temporaries are reused
+std::vector<Instruction> ExpressionDag::emit() const {
+    std::vector<std::size_t> segment_ends;
+    return emit(std::span(&root_, 1), segment_ends);
+}
+
+// emits one postfix segment per root, subexpressions shared within or across segments are computed once
+std::vector<Instruction> ExpressionDag::emit(std::span<const std::uint32_t> roots, std::vector<std::size_t>& segment_ends) const {
+    constexpr std::size_t no_slot = static_cast<std::size_t>(-1);
+
+    std::pmr::memory_resource* resource = nodes_.get_allocator().resource();
+    std::vector<Instruction> program;
+    program.reserve(nodes_.size());
+    std::pmr::vector<std::size_t> temporaries(nodes_.size(), no_slot, resource);
+    std::pmr::vector<std::uint32_t> remaining_uses(nodes_.size(), resource);
+    std::pmr::vector<std::size_t> free_slots(resource);
+    std::size_t slot_count = 0;
+
+    // depth first traversal without recursion, deeply nested expressions would overflow the call stack
+    struct Pending {
+        std::uint32_t node;
+        bool expanded;
+    };
+    std::pmr::vector<Pending> pending(resource);
+    segment_ends.clear();
+    for (const std::uint32_t root : roots) {
+        pending.push_back({root, false});
+        while (!pending.empty()) {
+            const std::uint32_t index = pending.back().node;
+            const DagNode& node = nodes_[index];
+
+            if (node.type == Instruction::Type::Number) {
+                program.push_back({Instruction::Type::Number, node.value});
+            } else if (node.type == Instruction::Type::Variable) {
+                program.push_back({Instruction::Type::Variable, 0.0, {}, node.slot});
+            } else if (temporaries[index] != no_slot) {
+                program.push_back({Instruction::Type::Load, 0.0, {}, temporaries[index]});
+                if (--remaining_uses[index] == 0) {
+                    free_slots.push_back(temporaries[index]);
+                }
+            } else if (!pending.back().expanded) {
+                pending.back().expanded = true;
+                for (std::uint32_t i = node.operand_count; i-- > 0;) {
+                    pending.push_back({node.operands[i], false});
+                }
+                continue;
+            } else {
+                if (node.type == Instruction::Type::Call) {
+                    program.push_back({Instruction::Type::Call, 0.0, {}, node.slot});
+                } else {
+                    program.push_back({Instruction::Type::Operator, 0.0, node.op});
+                }
+                if (node.uses > 1) {
+                    std::size_t slot = slot_count;
+                    if (free_slots.empty()) {
+                        ++slot_count;
+                    } else {
+                        slot = free_slots.back();
+                        free_slots.pop_back();
+                    }
+                    temporaries[index] = slot;
+                    remaining_uses[index] = node.uses - 1;
+                    program.push_back({Instruction::Type::Store, 0.0, {}, slot});
+                }
+            }
+            pending.pop_back();
+        }
+        segment_ends.push_back(program.size());
+    }
+
+    // temporaries go above the deepest operand, every segment starts on an empty stack
+    std::size_t depth = 0;
+    std::size_t max_depth = 0;
+    auto segment_end = segment_ends.begin();
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (i == *segment_end) {
+            depth = 0;
+            ++segment_end;
+        }
+        if (program[i].type == Instruction::Type::Operator) {
+            --depth;
+        } else if (program[i].type == Instruction::Type::Call) {
+            depth -= function_definition(program[i].slot).arity - 1;
+        } else if (program[i].type != Instruction::Type::Store) {
+            max_depth = std::max(max_depth, ++depth);
+        }
+    }
+    for (Instruction& instruction : program) {
+        if (instruction.type == Instruction::Type::Store || instruction.type == Instruction::Type::Load) {
+            instruction.slot += max_depth;
+        }
+    }
+    return program;
+}
+
+// rewrites a program so every repeated subexpression is computed only once
+void eliminate_common_subexpressions(std::vector<Instruction>& program, std::pmr::memory_resource* resource) {
+    const auto dag = ExpressionDag::build(program, resource);
+    if (!dag) {
+        return;
+    }
+
+    const bool shared = std::ranges::any_of(dag->nodes(), [](const DagNode& node) {
+        return node.operand_count > 0 && node.uses > 1;
+    });
+    if (shared) {
+        program = dag->emit();
+    }
+}
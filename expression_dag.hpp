@@ -0,0 +1,90 @@
+#ifndef EXPRESSION_DAG_HPP
+#define EXPRESSION_DAG_HPP
+
+#include "expression_evaluator.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_map>
+
+// node of an expression graph, operands refer to earlier nodes of the same graph
+struct DagNode {
+    Instruction::Type type; // Number, Variable, Operator or Call
+    double value = 0.0;
+    Operator op = {};
+    std::size_t slot = 0; // variable slot or function id
+    std::array<std::uint32_t, max_function_arity> operands{}; // lhs and rhs of an operator, arguments of a call
+    std::uint32_t operand_count = 0;
+    std::uint32_t uses = 0; // references from other nodes and the root
+};
+
+// expression as a directed acyclic graph in which structurally equal subexpressions are a single node,
+// nodes are kept in one contiguous array and refer to each other by index, all memory of the graph
+// comes from the given resource, typically the arena of one compilation
+class ExpressionDag {
+public:
+    explicit ExpressionDag(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // builds the graph of a postfix program, returns an error if it is malformed or already uses temporaries
+    static std::expected<ExpressionDag, EvalError> build(std::span<const Instruction> program,
+                                                         std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // returns the node pushing a number, creating it unless an identical one exists
+    std::uint32_t add_number(double value);
+
+    // returns the node reading a variable slot, creating it unless an identical one exists
+    std::uint32_t add_variable(std::size_t slot);
+
+    // returns the node applying an operator, creating it unless an identical one exists,
+    // operands of commutative operators are matched in either order
+    std::uint32_t add_operator(Operator op, std::uint32_t lhs, std::uint32_t rhs);
+
+    // returns the node calling a function with one argument node per parameter, creating it unless an
+    // identical one exists
+    std::uint32_t add_call(std::size_t function, std::span<const std::uint32_t> arguments);
+
+    // counts a node as the result of an expression, the graph of build() has its root counted already
+    void add_root(std::uint32_t node) { ++nodes_[node].uses; }
+
+    // emits a postfix program computing every shared subexpression once, keeping its value in a temporary
+    // stack slot above the operands until its last use, slots of dead temporaries are reused
+    std::vector<Instruction> emit() const;
+
+    // emits one postfix segment per root, each leaving only its result on the stack, subexpressions shared
+    // within or across segments are computed once and loaded by later segments, segment_ends receives the
+    // end of every segment, roots must have been counted with add_root()
+    std::vector<Instruction> emit(std::span<const std::uint32_t> roots, std::vector<std::size_t>& segment_ends) const;
+
+    const std::pmr::vector<DagNode>& nodes() const { return nodes_; }
+    std::uint32_t root() const { return root_; }
+
+private:
+    // identity of a node for hash consing, value holds the bits of a number, the slot of a variable or the
+    // id of a function
+    struct NodeKey {
+        Instruction::Type type;
+        Operator op;
+        std::uint64_t value;
+        std::array<std::uint32_t, max_function_arity> operands;
+
+        bool operator==(const NodeKey&) const = default;
+    };
+
+    struct NodeKeyHash {
+        std::size_t operator()(const NodeKey& key) const;
+    };
+
+    // returns the node of key, adding node and counting the uses of its operands unless it exists
+    std::uint32_t intern(const NodeKey& key, const DagNode& node);
+
+    std::pmr::vector<DagNode> nodes_;
+    std::pmr::unordered_map<NodeKey, std::uint32_t, NodeKeyHash> index_;
+    std::uint32_t root_ = 0;
+};
+
+// rewrites a program so every repeated subexpression is computed only once, the graph and scratch buffers
+// are allocated from resource, programs that are malformed or already use temporaries are left unchanged
+void eliminate_common_subexpressions(std::vector<Instruction>& program,
+                                     std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+#endif //EXPRESSION_DAG_HPP
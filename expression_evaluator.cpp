@@ -1,120 +1,122 @@
 #include "expression_evaluator.hpp"
+#include "expression_dag.hpp"
+#include "jit_compiler.hpp"
+#include "register_vm.hpp"
+
+// returns the description of an error code
+const char* eval_error_message(EvalErrorCode code) {
+    switch (code) {
+        case EvalErrorCode::EmptyExpression:
+            return "Empty expression";
+        case EvalErrorCode::MismatchedParentheses:
+            return "Mismatched parentheses";
+        case EvalErrorCode::MissingOperator:
+            return "Invalid expression: missing operator";
+        case EvalErrorCode::UnexpectedOperator:
+            return "Invalid expression: unexpected operator";
+        case EvalErrorCode::InvalidOperator:
+            return "Invalid operator";
+        case EvalErrorCode::InvalidNumber:
+            return "Invalid number";
+        case EvalErrorCode::NumberOutOfRange:
+            return "Number out of range";
+        case EvalErrorCode::NotEnoughOperands:
+            return "Invalid expression: not enough operands";
+        case EvalErrorCode::TooManyOperands:
+            return "Invalid expression: too many operands";
+        case EvalErrorCode::UnknownVariable:
+            return "Unknown variable";
+        case EvalErrorCode::InvalidVariableSlot:
+            return "Invalid variable slot";
+        case EvalErrorCode::NotEnoughBindings:
+            return "Not enough variable bindings";
+        case EvalErrorCode::DivisionByZero:
+            return "Division by zero";
+        case EvalErrorCode::InvalidTemporarySlot:
+            return "Invalid temporary slot";
+        case EvalErrorCode::NestingTooDeep:
+            return "Expression nested too deeply";
+        case EvalErrorCode::UnknownFunction:
+            return "Unknown function";
+        case EvalErrorCode::WrongArgumentCount:
+            return "Wrong number of function arguments";
+        case EvalErrorCode::UnexpectedSeparator:
+            return "Argument separator outside a function call";
+        case EvalErrorCode::NotRepresentable:
+            return "Result not representable in the value type";
+    }
+    return "Unknown error";
+}
+
+// describes an error, quoting the offending text of the expression it was reported for
+std::string describe(const EvalError& error, std::string_view expression) {
+    std::string description = eval_error_message(error.code);
+    if (error.position == EvalError::no_position || error.position > expression.size()) {
+        return description;
+    }
+
+    if (error.length > 0) {
+        description += ": ";
+        description += expression.substr(error.position, error.length);
+    }
+    description += " at position " + std::to_string(error.position);
+    return description;
+}
+
+EvaluationError::EvaluationError(const EvalError& error, std::string_view expression)
+        : std::runtime_error(describe(error, expression)), error_(error) {
+}
+
+// returns the symbol of an Operator
+const std::string& operator_symbol(Operator op) {
+    static const std::string symbols[] = {"+", "-", "*", "/", "^"};
+    return symbols[static_cast<std::size_t>(op)];
+}
 
 // checks whether op1 has lower precedence compared to op2 or is left associative
-bool has_lower_precedence(const std::string& op1_str, const std::string& op2_str) {
+bool has_lower_precedence(std::string_view op1_str, std::string_view op2_str) {
     if (op1_str == "(" || op2_str == "(" || op1_str == ")" || op2_str == ")") {
         return false;
     }
-    const OperatorProperty& op1 = operator_properties.at(op1_str);
-    const OperatorProperty& op2 = operator_properties.at(op2_str);
-    if(op1.priority == op2.priority) {
-        return op1.left_associative;
-    }
-    return op1.priority < op2.priority;
-}
-
-// converts an expression from infix to postfix notation using shunting yard algorithm
-// https://en.wikipedia.org/wiki/Shunting_yard_algorithm
-std::queue<std::string> infix_to_postfix(const std::string& expression) {
-    std::queue<std::string> output;
-    std::stack<std::string> operators;
-
-    std::string current_num;
-    for (std::size_t i = 0; i < expression.length(); ++i) {
-        const char current_char = expression[i];
-
-        // parse number
-        if (isdigit(current_char) || current_char == '.' || current_char == ',') {
-            if(current_char == ',') { // is decimal point
-                current_num += '.';
-            } else { // is number
-                current_num += current_char;
-            }
-
-        // parenthesis support
-        } else if (current_char == '(') {
-            operators.emplace("(");
-        } else if (current_char == ')') {
-            // push last number in parentheses
-            if (!current_num.empty()) {
-                output.push(current_num);
-                current_num.clear();
-            }
-
-            // push operators to output until '(' is encountered
-            while (!operators.empty() && operators.top() != "(") {
-                output.push(operators.top());
-                operators.pop();
-            }
-
-            if (!operators.empty()) {
-                operators.pop(); // remove '(' from the operators stack
-            } else {
-                throw std::runtime_error("Mismatched parentheses");
-            }
-
-        // character is an arithmetic or unary operator
-        } else if (current_char != ' ') {
-            if(i == 0 || !isdigit(expression[i-1]) && expression[i-1] != ')') { // unary operator
-                current_num += current_char;
-                continue;
-            }
-
-            // push parsed number to output stack
-            if (!current_num.empty()) {
-                output.push(current_num);
-                current_num.clear();
-            }
-
-            // handle operators
-            const std::string op (1, current_char);
-            while (!operators.empty() && operators.top() != "(" && has_lower_precedence(op, operators.top())) {
-                output.push(operators.top());
-                operators.pop();
-            }
-            operators.push(op);
-        }
-    }
+    return has_lower_precedence(operator_to_enum(op1_str), operator_to_enum(op2_str));
+}
 
-    // push last parsed number to output if present
-    if (!current_num.empty()) {
-        output.push(current_num);
+// converts expression from infix to postfix notation, throws EvaluationError if it is malformed
+std::vector<Token> infix_to_postfix(std::string_view expression) {
+    PostfixBuffers buffers;
+    if (const auto result = infix_to_postfix(expression, buffers); !result) {
+        throw EvaluationError(result.error(), expression);
     }
+    return std::move(buffers.output);
+}
 
-    // push the rest of operators
-    while (!operators.empty()) {
-        output.push(operators.top());
-        operators.pop();
+// converts expression from infix to postfix notation with a Pratt parser, throws EvaluationError if it is malformed
+std::vector<Token> pratt_to_postfix(std::string_view expression, std::size_t max_nesting) {
+    PostfixBuffers buffers;
+    if (const auto result = pratt_to_postfix(expression, buffers, max_nesting); !result) {
+        throw EvaluationError(result.error(), expression);
     }
-    return output;
+    return std::move(buffers.output);
 }
 
-// checks whether string is a number
-bool is_number(const std::string& s)
-{
-    if (s.empty()) return false;
-    return std::isdigit(s.back());
+// converts arithmetic operator to an Operator enum
+Operator operator_to_enum(std::string_view op) {
+    if (op.size() != 1)
+        throw std::runtime_error("Invalid operator: " + std::string(op));
+    return operator_to_enum(op[0]);
 }
 
-// converts arithmetic operator to an Operator enum
-Operator operator_to_enum(const std::string& op) {
-    if(op == "+")
-        return Operator::Addition;
-    if(op == "-")
-        return Operator::Subtraction;
-    if(op == "*")
-        return Operator::Multiplication;
-    if(op == "/")
-        return Operator::Division;
-    if(op == "^")
-        return Operator::Exponentiation;
-    throw std::runtime_error("Invalid operator: " + op);
+// applies an Operator on two operands, num2 being the left hand side
+double apply_operator(Operator op, double num2, double num1) {
+    if(op == Operator::Division && num1 == 0.0)
+        throw EvaluationError({EvalErrorCode::DivisionByZero});
+    return apply_arithmetic(op, num2, num1);
 }
 
 // applies an Operator on the first two top operands from the result stack
 void apply_operator(std::stack<double>& result, Operator op) {
     if (result.size() < 2) {
-        throw std::runtime_error("Not enough operands to perform operation");
+        throw EvaluationError({EvalErrorCode::NotEnoughOperands});
     }
     
     double num1 = result.top();
@@ -122,62 +124,246 @@ void apply_operator(std::stack<double>& result, Operator op) {
     double num2 = result.top();
     result.pop();
 
-    switch(op) {
-        case Operator::Addition:
-            result.push(num2+num1);
-            break;
-        case Operator::Subtraction:
-            result.push(num2-num1);
-            break;
-        case Operator::Multiplication:
-            result.push(num2*num1);
-            break;
-        case Operator::Division:
-            if(num1 == 0.0)
-                throw std::runtime_error("Division by zero");
-            result.push(num2/num1);
-            break;
-        case Operator::Exponentiation:
-            result.push(std::pow(num2, num1));
-            break;
-        default:
-            throw std::runtime_error("Invalid Operator enum value");
+    result.push(apply_operator(op, num2, num1));
+}
+
+// validates the program and computes the stack depth it needs
+CompiledExpression::CompiledExpression(std::vector<Instruction> program, std::vector<std::string> variables)
+        : program_(std::move(program)), variables_(std::move(variables)), jit_tier_(std::make_shared<JitTier>()) {
+    const auto depth = program_stack_depth(program_, variables_.size());
+    if (!depth) {
+        throw EvaluationError(depth.error());
     }
+    max_stack_depth_ = *depth;
+    register_program_ = RegisterProgram::compile(program_, max_stack_depth_);
 }
 
-// converts an expression to postfix notation and then evaluates it
-double evaluate(const std::string& expression) {
-    if(expression.empty())
-        throw std::runtime_error("Empty expression");
-
-    std::queue<std::string> postfix_expr = infix_to_postfix(expression);
-    std::stack<double> result;
-
-    while(!postfix_expr.empty()) {
-        const std::string& token = postfix_expr.front();
-
-        if(is_number(token)){
-            try {
-                result.push(std::stod(token));
-            } catch (const std::invalid_argument& e) {
-                throw std::runtime_error("Invalid number: " + token + "\n");
-            } catch (const std::out_of_range& e) {
-                throw std::runtime_error("Number out of range: " + token + "\n");
-            }
-        } else {
-            if (result.size() < 2) {
-                throw std::runtime_error("Invalid expression: not enough operands");
-            }
-
-            Operator op;
-               op = operator_to_enum(token);
-            apply_operator(result, op);
+CompiledExpression::CompiledExpression(std::vector<Instruction> program, std::vector<std::string> variables, std::size_t max_stack_depth)
+        : program_(std::move(program)), variables_(std::move(variables)), max_stack_depth_(max_stack_depth),
+          register_program_(RegisterProgram::compile(program_, max_stack_depth_)), jit_tier_(std::make_shared<JitTier>()) {
+}
+
+// validates the program, returns an error if it does not leave exactly one operand on the stack
+std::expected<CompiledExpression, EvalError> CompiledExpression::create(std::vector<Instruction> program, std::vector<std::string> variables) {
+    const auto depth = program_stack_depth(program, variables.size());
+    if (!depth) {
+        return std::unexpected(depth.error());
+    }
+    return CompiledExpression(std::move(program), std::move(variables), *depth);
+}
+
+// evaluates the compiled program, only valid for expressions without variables
+double CompiledExpression::eval() const {
+    return eval(std::span<const double>());
+}
+
+// evaluates the compiled program with bindings[slot] as the value of each variable
+double CompiledExpression::eval(std::span<const double> bindings) const {
+    const auto result = try_eval(bindings);
+    if (!result) {
+        throw EvaluationError(result.error());
+    }
+    return *result;
+}
+
+// evaluates the compiled program with bindings[slot] as the value of each variable without throwing
+std::expected<double, EvalError> CompiledExpression::try_eval(std::span<const double> bindings) const {
+    if (bindings.size() < variables_.size()) {
+        return std::unexpected(EvalError{EvalErrorCode::NotEnoughBindings});
+    }
+    record(Metric::Evaluations);
+    record_max(Metric::MaxStackDepth, max_stack_depth_);
+    const PhaseTimer timer(Metric::EvaluateNanoseconds);
+    if (const JitFunction* native = native_code(1)) {
+        return native->eval(bindings);
+    }
+
+    // programs that fit the inline buffer are evaluated without touching the heap,
+    // deeper ones use a per thread stack that only grows
+    if (max_stack_depth_ <= inline_stack_depth) {
+        std::array<double, inline_stack_depth> stack;
+        if (register_program_) {
+            return register_program_->run(bindings, stack.data());
         }
-        postfix_expr.pop();
+        return run_program(program_, bindings, stack.data());
+    }
+
+    thread_local std::vector<double> stack;
+    if (stack.size() < max_stack_depth_) {
+        stack.resize(max_stack_depth_);
     }
+    if (register_program_) {
+        return register_program_->run(bindings, stack.data());
+    }
+    return run_program(program_, bindings, stack.data());
+}
 
-    if (result.size() != 1) {
-        throw std::runtime_error("Invalid expression: too many operands");
+// records evaluations done by the caller, returns the native code once the program got hot and nullptr until then
+const JitFunction* CompiledExpression::native_code(std::size_t evaluations) const {
+    return jit_tier_ ? jit_tier_->record(*this, evaluations) : nullptr;
+}
+
+// returns the slot index of a variable
+std::size_t CompiledExpression::slot(std::string_view name) const {
+    const auto it = std::find(variables_.begin(), variables_.end(), name);
+    if (it == variables_.end()) {
+        throw std::runtime_error("Unknown variable: " + std::string(name));
     }
-    return result.top();
-}
\ No newline at end of file
+    return static_cast<std::size_t>(it - variables_.begin());
+}
+
+namespace {
+
+// upstream of the compilation arena, counts what did not fit the per thread memory
+class OverflowCounter : public std::pmr::memory_resource {
+public:
+    std::size_t bytes = 0;
+
+private:
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        bytes += size;
+        return std::pmr::get_default_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void* pointer, std::size_t size, std::size_t alignment) override {
+        std::pmr::get_default_resource()->deallocate(pointer, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// grows the arena memory after the arena released its blocks, so the next compilation of the same size fits entirely
+struct ArenaGrowth {
+    std::vector<std::byte>& memory;
+    const OverflowCounter& overflow;
+
+    ~ArenaGrowth() {
+        if (overflow.bytes > 0) {
+            memory.resize(memory.size() + overflow.bytes);
+        }
+    }
+};
+
+} // namespace
+
+// compiles an expression whose variables get slots in the order they first appear
+CompiledExpression compile(std::string_view expression) {
+    return compile(expression, {}, true);
+}
+
+// compiles an expression whose variables are bound to the slots given by their position in variables
+CompiledExpression compile(std::string_view expression, std::span<const std::string> variables) {
+    return compile(expression, variables, false);
+}
+
+// converts an expression to postfix notation and captures it as a compiled program
+CompiledExpression compile(std::string_view expression, std::span<const std::string> variables, bool add_unknown_variables) {
+    auto compiled = try_compile(expression, variables, add_unknown_variables);
+    if (!compiled) {
+        throw EvaluationError(compiled.error(), expression);
+    }
+    return std::move(*compiled);
+}
+
+// compiles an expression whose variables get slots in the order they first appear without throwing
+std::expected<CompiledExpression, EvalError> try_compile(std::string_view expression) {
+    return try_compile(expression, {}, true);
+}
+
+// compiles an expression whose variables are bound to the slots given by their position in variables without throwing
+std::expected<CompiledExpression, EvalError> try_compile(std::string_view expression, std::span<const std::string> variables) {
+    return try_compile(expression, variables, false);
+}
+
+// converts an expression to postfix notation and captures it as a compiled program without throwing
+std::expected<CompiledExpression, EvalError> try_compile(std::string_view expression, std::span<const std::string> variables,
+                                                         bool add_unknown_variables, bool fold_constants) {
+    // tokens, operator stack and expression graph live in one arena released when compilation ends,
+    // its memory is kept per thread and grown to the biggest compilation so far
+    thread_local std::vector<std::byte> arena_memory(16 * 1024);
+    OverflowCounter overflow;
+    const ArenaGrowth growth{arena_memory, overflow};
+    std::pmr::monotonic_buffer_resource arena(arena_memory.data(), arena_memory.size(), &overflow);
+
+    record(Metric::Expressions);
+    std::uint64_t phase_start = instrumentation_now();
+    BasicPostfixBuffers<std::pmr::polymorphic_allocator<Token>> buffers(&arena);
+    const auto postfix = infix_to_postfix(expression, buffers);
+    record_phase(Metric::ParseNanoseconds, phase_start);
+    if (!postfix) {
+        return std::unexpected(postfix.error());
+    }
+    record(Metric::Tokens, buffers.output.size());
+
+    phase_start = instrumentation_now();
+    std::vector<std::string> slots(variables.begin(), variables.end());
+    std::vector<Instruction> program;
+    program.reserve(buffers.output.size());
+    const auto lowered = append_instructions(expression, buffers.output, slots, add_unknown_variables, program);
+    record_phase(Metric::LowerNanoseconds, phase_start);
+    if (!lowered) {
+        return std::unexpected(lowered.error());
+    }
+
+    phase_start = instrumentation_now();
+    optimize_program(program, fold_constants);
+    eliminate_common_subexpressions(program, &arena);
+    record_phase(Metric::OptimizeNanoseconds, phase_start);
+    return CompiledExpression::create(std::move(program), std::move(slots));
+}
+
+// converts an expression to postfix notation and then evaluates it
+double evaluate(std::string_view expression) {
+    const auto result = try_evaluate(expression);
+    if (!result) {
+        throw EvaluationError(result.error(), expression);
+    }
+    return *result;
+}
+
+// converts an expression to postfix notation and then evaluates it without throwing,
+// all intermediate buffers are kept per thread so repeated calls do not allocate
+std::expected<double, EvalError> try_evaluate(std::string_view expression) {
+    struct EvaluationBuffers {
+        PostfixBuffers postfix;
+        std::vector<std::string> variables;
+        std::vector<Instruction> program;
+        std::vector<double> stack;
+    };
+    thread_local EvaluationBuffers buffers;
+
+    record(Metric::Expressions);
+    std::uint64_t phase_start = instrumentation_now();
+    const auto postfix = infix_to_postfix(expression, buffers.postfix);
+    record_phase(Metric::ParseNanoseconds, phase_start);
+    if (!postfix) {
+        return std::unexpected(postfix.error());
+    }
+    record(Metric::Tokens, buffers.postfix.output.size());
+
+    phase_start = instrumentation_now();
+    // nothing binds variables here, so the first one is reported where it appears in the expression
+    buffers.variables.clear();
+    buffers.program.clear();
+    const auto lowered = append_instructions(expression, buffers.postfix.output, buffers.variables, false, buffers.program);
+    record_phase(Metric::LowerNanoseconds, phase_start);
+    if (!lowered) {
+        return std::unexpected(lowered.error());
+    }
+
+    const auto depth = program_stack_depth(buffers.program, buffers.variables.size());
+    if (!depth) {
+        return std::unexpected(depth.error());
+    }
+    if (buffers.stack.size() < *depth) {
+        buffers.stack.resize(*depth);
+    }
+    record_max(Metric::MaxStackDepth, *depth);
+    record(Metric::Evaluations);
+    phase_start = instrumentation_now();
+    const auto result = run_program(buffers.program, {}, buffers.stack.data());
+    record_phase(Metric::EvaluateNanoseconds, phase_start);
+    return result;
+}
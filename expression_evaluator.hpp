@@ -1,22 +1,37 @@
 #ifndef EXPRESSION_EVALUATOR_HPP
 #define EXPRESSION_EVALUATOR_HPP
 
+#include "function_registry.hpp"
+#include "instrumentation.hpp"
+
 #include <iostream>
 #include <string>
 
 #include <stack>
 #include <unordered_map>
-#include <queue>
+#include <vector>
 
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
 #include <cmath>
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
 
 struct OperatorProperty {
     int priority;
     bool left_associative;
 };
 
-enum class Operator {
+enum class Operator : std::uint8_t {
     Addition,
     Subtraction,
     Multiplication,
@@ -33,6 +48,55 @@ const std::unordered_map<std::string, OperatorProperty> operator_properties {
         {"^", {3, false}},
 };
 
+// reasons why an expression fails to compile or evaluate
+enum class EvalErrorCode {
+    EmptyExpression,
+    MismatchedParentheses,
+    MissingOperator,
+    UnexpectedOperator,
+    InvalidOperator,
+    InvalidNumber,
+    NumberOutOfRange,
+    NotEnoughOperands,
+    TooManyOperands,
+    UnknownVariable,
+    InvalidVariableSlot,
+    NotEnoughBindings,
+    DivisionByZero,
+    InvalidTemporarySlot,
+    NestingTooDeep,
+    UnknownFunction,
+    WrongArgumentCount,
+    UnexpectedSeparator,
+    NotRepresentable,
+};
+
+// error of the non-throwing API, position and length locate the offending text in the expression
+struct EvalError {
+    static constexpr std::size_t no_position = static_cast<std::size_t>(-1);
+
+    EvalErrorCode code;
+    std::size_t position = no_position;
+    std::size_t length = 0;
+};
+
+// returns the description of an error code
+const char* eval_error_message(EvalErrorCode code);
+
+// describes an error, quoting the offending text of the expression it was reported for
+std::string describe(const EvalError& error, std::string_view expression = {});
+
+// exception thrown by the throwing API, carries the same EvalError the non-throwing API returns
+class EvaluationError : public std::runtime_error {
+public:
+    EvaluationError(const EvalError& error, std::string_view expression = {});
+
+    const EvalError& error() const { return error_; }
+
+private:
+    EvalError error_;
+};
+
 // outputs the elements of a stack to an ostream
 template<typename T>
 std::ostream& operator<<(std::ostream& os, std::stack<T> my_stack)
@@ -45,22 +109,1234 @@ std::ostream& operator<<(std::ostream& os, std::stack<T> my_stack)
     return os; // end of function
 }
 
+// a number, variable, operator or parenthesis of an expression in postfix notation,
+// numbers and variable names refer to their text in the expression
+struct Token {
+    enum class Type : std::uint8_t {
+        Number,
+        Variable,
+        Operator,
+        Negation, // unary minus applied to the preceding variable, parenthesis or call
+        Call, // function applied to the arguments before it
+        LeftParenthesis, // only present on the operator stack
+        Function, // opening parenthesis of a call, only present on the operator stack
+    };
+
+    Type type;
+    Operator op = {}; // operation of Type::Operator
+    bool negative = false; // unary minus applied to a parenthesis or call
+    std::uint16_t function = 0; // id of Type::Call and Type::Function
+    std::uint16_t arguments = 0; // arguments of Type::Function seen so far
+    std::size_t position = 0; // first character of a number or variable name
+    std::size_t length = 0;
+    double value = 0.0; // parsed value of Type::Number, including its unary sign
+};
+
+// output and operator stack of infix_to_postfix, reused between conversions to avoid allocations
+template<typename Allocator = std::allocator<Token>>
+struct BasicPostfixBuffers {
+    constexpr BasicPostfixBuffers() = default;
+
+    // both stacks allocate from allocator, e.g. a per compilation arena
+    explicit constexpr BasicPostfixBuffers(const Allocator& allocator) : output(allocator), operators(allocator) {
+    }
+
+    std::vector<Token, Allocator> output;
+    std::vector<Token, Allocator> operators;
+};
+
+using PostfixBuffers = BasicPostfixBuffers<>;
+
+// returns the symbol of an Operator
+const std::string& operator_symbol(Operator op);
+
+// priorities and left associativity of arithmetic operators indexed by Operator, usable in constant expressions
+constexpr std::array<OperatorProperty, 5> operator_property_table {{
+        {1, true},
+        {1, true},
+        {2, true},
+        {2, true},
+        {3, false},
+}};
+
 // checks whether op1 has lower precedence or is left associative
-bool has_lower_precedence(const std::string& current_operation, const std::string& last_stack_operation);
+bool has_lower_precedence(std::string_view current_operation, std::string_view last_stack_operation);
 
-// converts expression from infix to postfix notation
-std::queue<std::string> infix_to_postfix(const std::string& expression);
+// checks whether op1 has lower precedence or is left associative
+constexpr bool has_lower_precedence(Operator current_operation, Operator last_stack_operation) {
+    const OperatorProperty& op1 = operator_property_table[static_cast<std::size_t>(current_operation)];
+    const OperatorProperty& op2 = operator_property_table[static_cast<std::size_t>(last_stack_operation)];
+    if (op1.priority == op2.priority) {
+        return op1.left_associative;
+    }
+    return op1.priority < op2.priority;
+}
 
-// checks whether string is a number
-bool is_number(const std::string& s);
+// lexical class of a character, the lexer dispatches on it once per token instead of testing each kind in turn
+enum class CharacterClass : std::uint8_t {
+    Invalid,
+    Space,
+    Digit,
+    Letter, // starts a variable name, '_' included
+    Point, // '.' or ',' starting a number
+    Operator,
+    LeftParenthesis,
+    RightParenthesis,
+    Separator, // ';' between function arguments
+};
+
+// class of every character, indexed by its unsigned value
+constexpr std::array<CharacterClass, 256> character_classes = [] {
+    std::array<CharacterClass, 256> classes{};
+    for (char c = '0'; c <= '9'; ++c) {
+        classes[static_cast<unsigned char>(c)] = CharacterClass::Digit;
+    }
+    for (char c = 'a'; c <= 'z'; ++c) {
+        classes[static_cast<unsigned char>(c)] = CharacterClass::Letter;
+        classes[static_cast<unsigned char>(c - 'a' + 'A')] = CharacterClass::Letter;
+    }
+    classes['_'] = CharacterClass::Letter;
+    classes[' '] = CharacterClass::Space;
+    classes['.'] = CharacterClass::Point;
+    classes[','] = CharacterClass::Point;
+    for (const char c : {'+', '-', '*', '/', '^'}) {
+        classes[static_cast<unsigned char>(c)] = CharacterClass::Operator;
+    }
+    classes[';'] = CharacterClass::Separator;
+    classes['('] = CharacterClass::LeftParenthesis;
+    classes[')'] = CharacterClass::RightParenthesis;
+    return classes;
+}();
+
+// Operator of every character of CharacterClass::Operator, indexed by its unsigned value
+constexpr std::array<Operator, 256> character_operators = [] {
+    std::array<Operator, 256> operators{};
+    operators['+'] = Operator::Addition;
+    operators['-'] = Operator::Subtraction;
+    operators['*'] = Operator::Multiplication;
+    operators['/'] = Operator::Division;
+    operators['^'] = Operator::Exponentiation;
+    return operators;
+}();
+
+// returns the lexical class of a character
+constexpr CharacterClass character_class(char c) {
+    return character_classes[static_cast<unsigned char>(c)];
+}
+
+// checks whether character is a decimal digit
+constexpr bool is_digit(char c) {
+    return character_class(c) == CharacterClass::Digit;
+}
+
+// checks whether character can be part of a number or a variable name
+constexpr bool is_operand_char(char c) {
+    const CharacterClass type = character_class(c);
+    return type == CharacterClass::Digit || type == CharacterClass::Letter;
+}
+
+// checks whether character is one of the arithmetic operators
+constexpr bool is_operator_char(char c) {
+    return character_class(c) == CharacterClass::Operator;
+}
+
+// converts arithmetic operator to an Operator enum
+constexpr Operator operator_to_enum(char op) {
+    if (!is_operator_char(op)) {
+        throw std::runtime_error(std::string("Invalid operator: ") + op);
+    }
+    return character_operators[static_cast<unsigned char>(op)];
+}
 
 // converts arithmetic operator to an Operator enum
-Operator operator_to_enum(const std::string& op);
+Operator operator_to_enum(std::string_view op);
+
+// converts digits with an optional '.' fraction and exponent during constant evaluation, where std::from_chars
+// is not available, exact as long as the digits fit 53 bits and the power of ten does not exceed 10^22,
+// other numbers may differ from std::from_chars in the last bit
+constexpr std::expected<double, EvalErrorCode> constant_decimal_to_double(std::string_view number) {
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    bool truncated = false;
+    std::size_t digits = 0;
+    std::size_t i = 0;
+    for (bool fraction = false; i < number.size() && (is_digit(number[i]) || (number[i] == '.' && !fraction)); ++i) {
+        if (number[i] == '.') {
+            fraction = true;
+            continue;
+        }
+        ++digits;
+        if (mantissa < std::numeric_limits<std::uint64_t>::max() / 10 - 9) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(number[i] - '0');
+            exponent -= fraction;
+        } else {
+            // digits past the precision of the mantissa only scale it
+            truncated = true;
+            exponent += !fraction;
+        }
+    }
+    if (digits == 0) {
+        return std::unexpected(EvalErrorCode::InvalidNumber);
+    }
+    if (i < number.size()) {
+        const bool negative = number[++i] == '-';
+        i += number[i] == '-' || number[i] == '+';
+        int written = 0;
+        for (; i < number.size(); ++i) {
+            written = std::min(written * 10 + (number[i] - '0'), 100000);
+        }
+        exponent += negative ? -written : written;
+    }
+
+    constexpr double exact_powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    double value = static_cast<double>(mantissa);
+    if (mantissa == 0) {
+        return 0.0;
+    }
+    if (!truncated && mantissa <= (std::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        return exponent < 0 ? value / exact_powers[-exponent] : value * exact_powers[exponent];
+    }
+
+    // steps in extended precision, so only rarely more than the last bit may be off
+    auto extended = static_cast<long double>(mantissa);
+    for (; exponent > 0 && extended <= std::numeric_limits<double>::max(); exponent -= std::min(exponent, 22)) {
+        extended *= static_cast<long double>(exact_powers[std::min(exponent, 22)]);
+    }
+    for (; exponent < 0 && extended > 0.0L; exponent += std::min(-exponent, 22)) {
+        extended /= static_cast<long double>(exact_powers[std::min(-exponent, 22)]);
+    }
+    if (extended > std::numeric_limits<double>::max() || extended < std::numeric_limits<double>::min()) {
+        return std::unexpected(EvalErrorCode::NumberOutOfRange);
+    }
+    value = static_cast<double>(extended);
+    return value;
+}
+
+// parses the number at the start of text directly from the buffer with std::from_chars,
+// ',' is accepted as decimal point and an exponent may follow, returns the number of characters consumed
+constexpr std::expected<std::size_t, EvalError> parse_number(std::string_view text, double& value) {
+    // digits are accumulated while scanning, so short numbers need no second pass
+    std::uint64_t mantissa = 0;
+    std::size_t digits = 0;
+    std::size_t end = 0;
+    for (; end < text.size() && is_digit(text[end]); ++end, ++digits) {
+        mantissa = mantissa * 10 + static_cast<std::uint64_t>(text[end] - '0');
+    }
+
+    bool decimal_comma = false;
+    std::size_t fraction_digits = 0;
+    if (end < text.size() && (text[end] == '.' || text[end] == ',')) {
+        decimal_comma = text[end] == ',';
+        for (++end; end < text.size() && is_digit(text[end]); ++end, ++digits, ++fraction_digits) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(text[end] - '0');
+        }
+    }
+    const std::size_t significand_end = end;
+
+    // exponent is only part of the number when digits follow
+    if (end < text.size() && (text[end] == 'e' || text[end] == 'E')) {
+        std::size_t exponent = end + 1;
+        if (exponent < text.size() && (text[exponent] == '-' || text[exponent] == '+')) {
+            ++exponent;
+        }
+        if (exponent < text.size() && is_digit(text[exponent])) {
+            end = exponent;
+            while (end < text.size() && is_digit(text[end])) {
+                ++end;
+            }
+        }
+    }
+
+    // a number directly followed by more operand characters is malformed as a whole
+    std::size_t run_end = end;
+    while (run_end < text.size() && (is_operand_char(text[run_end]) || text[run_end] == '.' || text[run_end] == ',')) {
+        ++run_end;
+    }
+    if (run_end != end) {
+        return std::unexpected(EvalError{EvalErrorCode::InvalidNumber, 0, run_end});
+    }
+
+    // both the digits and the power of ten are exact doubles, so one division rounds exactly like std::from_chars
+    constexpr double exact_powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (end == significand_end && digits > 0 && digits <= 15 && fraction_digits <= 22) {
+        value = static_cast<double>(mantissa) / exact_powers[fraction_digits];
+        return end;
+    }
+
+    // std::from_chars only knows '.', numbers with a decimal comma are copied to a local buffer first
+    std::string_view number = text.substr(0, end);
+    std::array<char, 128> buffer;
+    if (decimal_comma) {
+        if (number.size() > buffer.size()) {
+            return std::unexpected(EvalError{EvalErrorCode::InvalidNumber, 0, end});
+        }
+        std::replace_copy(number.begin(), number.end(), buffer.begin(), ',', '.');
+        number = std::string_view(buffer.data(), number.size());
+    }
+
+    if consteval {
+        const auto constant = constant_decimal_to_double(number);
+        if (!constant) {
+            return std::unexpected(EvalError{constant.error(), 0, std::max<std::size_t>(end, 1)});
+        }
+        value = *constant;
+    } else {
+        const auto [ptr, error] = std::from_chars(number.data(), number.data() + number.size(), value);
+        if (error == std::errc::result_out_of_range) {
+            return std::unexpected(EvalError{EvalErrorCode::NumberOutOfRange, 0, end});
+        }
+        if (error != std::errc() || ptr != number.data() + number.size()) {
+            return std::unexpected(EvalError{EvalErrorCode::InvalidNumber, 0, std::max<std::size_t>(end, 1)});
+        }
+    }
+    return end;
+}
+
+// parses the number starting at position into a Number token carrying its unary sign, returns its length
+template<typename Output>
+constexpr std::expected<std::size_t, EvalError> append_number(std::string_view expression, std::size_t position, bool negative, Output& output) {
+    double value = 0.0;
+    std::uint64_t number_start = instrumentation_now(); // not const, its initializer would count as constant evaluation
+    const auto length = parse_number(expression.substr(position), value);
+    record_phase(Metric::NumberParseNanoseconds, number_start);
+    record(Metric::Numbers);
+    if (!length) {
+        return std::unexpected(EvalError{length.error().code, position, length.error().length});
+    }
+    output.push_back({Token::Type::Number, {}, false, 0, 0, position, *length, negative ? -value : value});
+    return *length;
+}
+
+// returns the position of the '(' opening a call after a name ending at end, npos if the name is a variable
+constexpr std::size_t call_parenthesis(std::string_view expression, std::size_t end) {
+    while (end < expression.size() && character_class(expression[end]) == CharacterClass::Space) {
+        ++end;
+    }
+    return end < expression.size() && expression[end] == '(' ? end : std::string_view::npos;
+}
+
+// converts an expression from infix to postfix notation into buffers.output using shunting yard algorithm
+// https://en.wikipedia.org/wiki/Shunting_yard_algorithm
+template<typename Allocator>
+constexpr std::expected<void, EvalError> infix_to_postfix(std::string_view expression, BasicPostfixBuffers<Allocator>& buffers) {
+    auto& output = buffers.output;
+    auto& operators = buffers.operators;
+    output.clear();
+    operators.clear();
+
+    bool expect_operand = true; // next token starts an operand, so '-' and '+' are unary
+    bool negative = false; // unary minus waiting for its operand
+    for (std::size_t i = 0; i < expression.length(); ++i) {
+        const char current_char = expression[i];
+        switch (character_class(current_char)) {
+            case CharacterClass::Space:
+                break;
+
+            // variable name or function call
+            case CharacterClass::Letter: {
+                if (!expect_operand) {
+                    return std::unexpected(EvalError{EvalErrorCode::MissingOperator, i, 1});
+                }
+                std::size_t end = i + 1;
+                while (end < expression.length() && is_operand_char(expression[end])) {
+                    ++end;
+                }
+                if (const std::size_t parenthesis = call_parenthesis(expression, end); parenthesis != std::string_view::npos) {
+                    const auto function = find_function(expression.substr(i, end - i));
+                    if (!function) {
+                        return std::unexpected(EvalError{EvalErrorCode::UnknownFunction, i, end - i});
+                    }
+                    operators.push_back({Token::Type::Function, {}, negative, static_cast<std::uint16_t>(*function), 0, i, end - i});
+                    i = parenthesis;
+                    negative = false;
+                    break;
+                }
+                output.push_back({Token::Type::Variable, {}, false, 0, 0, i, end - i});
+                if (negative) {
+                    output.push_back({Token::Type::Negation});
+                }
+                i = end - 1;
+                negative = false;
+                expect_operand = false;
+                break;
+            }
+
+            // number, parsed in place and stored in the token with its unary sign
+            case CharacterClass::Digit:
+            case CharacterClass::Point: {
+                if (!expect_operand) {
+                    return std::unexpected(EvalError{EvalErrorCode::MissingOperator, i, 1});
+                }
+                const auto length = append_number(expression, i, negative, output);
+                if (!length) {
+                    return std::unexpected(length.error());
+                }
+                i += *length - 1;
+                negative = false;
+                expect_operand = false;
+                break;
+            }
+
+            case CharacterClass::LeftParenthesis:
+                if (!expect_operand) {
+                    return std::unexpected(EvalError{EvalErrorCode::MissingOperator, i, 1});
+                }
+                operators.push_back({Token::Type::LeftParenthesis, {}, negative, 0, 0, i, 1});
+                negative = false;
+                break;
+
+            case CharacterClass::RightParenthesis:
+                if (expect_operand) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands, i, 1});
+                }
+
+                // push operators to output until '(' or a call is encountered
+                while (!operators.empty() && operators.back().type == Token::Type::Operator) {
+                    output.push_back(operators.back());
+                    operators.pop_back();
+                }
+
+                if (operators.empty()) {
+                    return std::unexpected(EvalError{EvalErrorCode::MismatchedParentheses, i, 1});
+                }
+                if (const Token& open = operators.back(); open.type == Token::Type::Function) {
+                    if (open.arguments + 1u != function_definition(open.function).arity) {
+                        return std::unexpected(EvalError{EvalErrorCode::WrongArgumentCount, open.position, open.length});
+                    }
+                    output.push_back({Token::Type::Call, {}, false, open.function, 0, open.position, open.length});
+                }
+                if (operators.back().negative) {
+                    output.push_back({Token::Type::Negation});
+                }
+                operators.pop_back(); // remove '(' from the operators stack
+                break;
+
+            // completes an argument of the innermost call
+            case CharacterClass::Separator:
+                if (expect_operand) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands, i, 1});
+                }
+                while (!operators.empty() && operators.back().type == Token::Type::Operator) {
+                    output.push_back(operators.back());
+                    operators.pop_back();
+                }
+                if (operators.empty() || operators.back().type != Token::Type::Function) {
+                    return std::unexpected(EvalError{EvalErrorCode::UnexpectedSeparator, i, 1});
+                }
+                // saturates, a call with more arguments than any function takes is rejected at its ')'
+                if (operators.back().arguments < max_function_arity) {
+                    ++operators.back().arguments;
+                }
+                expect_operand = true;
+                break;
+
+            // arithmetic or unary operator
+            case CharacterClass::Operator: {
+                const Operator op = character_operators[static_cast<unsigned char>(current_char)];
+                if (expect_operand) { // unary operator
+                    if (op != Operator::Subtraction && op != Operator::Addition) {
+                        return std::unexpected(EvalError{EvalErrorCode::UnexpectedOperator, i, 1});
+                    }
+                    negative ^= op == Operator::Subtraction;
+                    break;
+                }
+
+                while (!operators.empty() && operators.back().type == Token::Type::Operator && has_lower_precedence(op, operators.back().op)) {
+                    output.push_back(operators.back());
+                    operators.pop_back();
+                }
+                operators.push_back({Token::Type::Operator, op, false, 0, 0, i, 1});
+                expect_operand = true;
+                break;
+            }
+
+            case CharacterClass::Invalid:
+                return std::unexpected(EvalError{EvalErrorCode::InvalidOperator, i, 1});
+        }
+    }
+
+    if (expect_operand) {
+        if (expression.find_first_not_of(' ') == std::string_view::npos) {
+            return std::unexpected(EvalError{EvalErrorCode::EmptyExpression});
+        }
+        return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands, expression.length()});
+    }
+
+    // push the rest of operators
+    while (!operators.empty()) {
+        if (operators.back().type != Token::Type::Operator) {
+            return std::unexpected(EvalError{EvalErrorCode::MismatchedParentheses, operators.back().position, 1});
+        }
+        output.push_back(operators.back());
+        operators.pop_back();
+    }
+    return {};
+}
+
+// converts expression from infix to postfix notation, throws EvaluationError if it is malformed
+std::vector<Token> infix_to_postfix(std::string_view expression);
+
+// nesting of parentheses and right associative operands pratt_to_postfix accepts by default
+inline constexpr std::size_t default_max_nesting = 1000;
+
+// top down operator precedence parser emitting the postfix tokens of each operand as soon as it is complete,
+// left associative chains are parsed in a loop, so only parentheses and right associative operands recurse
+// https://en.wikipedia.org/wiki/Operator-precedence_parser#Pratt_parsing
+template<typename Output>
+class PrattParser {
+public:
+    constexpr PrattParser(std::string_view expression, Output& output, std::size_t max_nesting)
+            : expression_(expression), output_(output), max_nesting_(max_nesting) {
+    }
+
+    // parses the whole expression, only an unmatched ')' can end the outermost level early
+    constexpr std::expected<void, EvalError> parse() {
+        output_.clear();
+        if (!parse_expression(0)) {
+            return std::unexpected(error_);
+        }
+        if (position_ < expression_.size()) {
+            const bool separator = character_class(expression_[position_]) == CharacterClass::Separator;
+            return std::unexpected(EvalError{separator ? EvalErrorCode::UnexpectedSeparator : EvalErrorCode::MismatchedParentheses,
+                                             position_, 1});
+        }
+        return {};
+    }
+
+private:
+    // the parse functions return false after storing the error, which keeps the recursion cheaper than
+    // passing std::expected up every level
+    constexpr bool fail(EvalErrorCode code, std::size_t position, std::size_t length = 1) {
+        error_ = {code, position, length};
+        return false;
+    }
+
+    constexpr void skip_spaces() {
+        while (position_ < expression_.size() && character_class(expression_[position_]) == CharacterClass::Space) {
+            ++position_;
+        }
+    }
+
+    // parses an operand followed by the binary operators with at least min_priority,
+    // stops before ')', ';', a weaker operator or the end
+    constexpr bool parse_expression(int min_priority) {
+        if (!parse_operand()) {
+            return false;
+        }
+        while (true) {
+            skip_spaces();
+            if (position_ == expression_.size()) {
+                return true;
+            }
+            switch (character_class(expression_[position_])) {
+                case CharacterClass::Operator:
+                    break;
+                case CharacterClass::RightParenthesis:
+                case CharacterClass::Separator:
+                    return true;
+                case CharacterClass::Invalid:
+                    return fail(EvalErrorCode::InvalidOperator, position_);
+                default:
+                    return fail(EvalErrorCode::MissingOperator, position_);
+            }
+
+            const Operator op = character_operators[static_cast<unsigned char>(expression_[position_])];
+            const OperatorProperty& property = operator_property_table[static_cast<std::size_t>(op)];
+            if (property.priority < min_priority) {
+                return true;
+            }
+            const std::size_t op_position = position_++;
+            const bool parsed = property.left_associative ? parse_expression(property.priority + 1)
+                                                          : parse_nested(op_position, property.priority);
+            if (!parsed) {
+                return false;
+            }
+            output_.push_back({Token::Type::Operator, op, false, 0, 0, op_position, 1});
+        }
+    }
+
+    // parses an expression one nesting level deeper, opened by the character at position
+    constexpr bool parse_nested(std::size_t position, int min_priority) {
+        if (++nesting_ > max_nesting_) {
+            return fail(EvalErrorCode::NestingTooDeep, position);
+        }
+        const bool parsed = parse_expression(min_priority);
+        --nesting_;
+        return parsed;
+    }
+
+    // parses the arguments of a call whose name starts at start, each one a nesting level deeper
+    constexpr bool parse_call(std::size_t start, std::size_t length, std::size_t parenthesis, bool negative) {
+        const auto function = find_function(expression_.substr(start, length));
+        if (!function) {
+            return fail(EvalErrorCode::UnknownFunction, start, length);
+        }
+
+        position_ = parenthesis + 1;
+        std::size_t arguments = 1;
+        while (true) {
+            if (!parse_nested(parenthesis, 0)) {
+                return false;
+            }
+            // arguments only stop at ')', ';' or the end
+            if (position_ == expression_.size()) {
+                return fail(EvalErrorCode::MismatchedParentheses, start);
+            }
+            if (expression_[position_++] == ')') {
+                break;
+            }
+            arguments = std::min(arguments + 1, max_function_arity + 1);
+        }
+        if (arguments != function_definition(*function).arity) {
+            return fail(EvalErrorCode::WrongArgumentCount, start, length);
+        }
+        output_.push_back({Token::Type::Call, {}, false, static_cast<std::uint16_t>(*function), 0, start, length});
+        if (negative) {
+            output_.push_back({Token::Type::Negation});
+        }
+        return true;
+    }
+
+    // parses unary signs and the number, variable, parenthesis or call they apply to
+    constexpr bool parse_operand() {
+        bool negative = false;
+        while (true) {
+            skip_spaces();
+            if (position_ == expression_.size()) {
+                if (expression_.find_first_not_of(' ') == std::string_view::npos) {
+                    return fail(EvalErrorCode::EmptyExpression, EvalError::no_position, 0);
+                }
+                return fail(EvalErrorCode::NotEnoughOperands, expression_.size(), 0);
+            }
+
+            const std::size_t start = position_;
+            switch (character_class(expression_[start])) {
+                case CharacterClass::Operator: {
+                    const Operator op = character_operators[static_cast<unsigned char>(expression_[start])];
+                    if (op != Operator::Subtraction && op != Operator::Addition) {
+                        return fail(EvalErrorCode::UnexpectedOperator, start);
+                    }
+                    negative ^= op == Operator::Subtraction;
+                    ++position_;
+                    break;
+                }
+                case CharacterClass::Letter:
+                    while (position_ < expression_.size() && is_operand_char(expression_[position_])) {
+                        ++position_;
+                    }
+                    if (const std::size_t parenthesis = call_parenthesis(expression_, position_); parenthesis != std::string_view::npos) {
+                        return parse_call(start, position_ - start, parenthesis, negative);
+                    }
+                    output_.push_back({Token::Type::Variable, {}, false, 0, 0, start, position_ - start});
+                    if (negative) {
+                        output_.push_back({Token::Type::Negation});
+                    }
+                    return true;
+                case CharacterClass::Digit:
+                case CharacterClass::Point: {
+                    const auto length = append_number(expression_, start, negative, output_);
+                    if (!length) {
+                        error_ = length.error();
+                        return false;
+                    }
+                    position_ += *length;
+                    return true;
+                }
+                case CharacterClass::LeftParenthesis:
+                    ++position_;
+                    if (!parse_nested(start, 0)) {
+                        return false;
+                    }
+                    // the inner expression only stops at ')', ';' or the end
+                    if (position_ == expression_.size()) {
+                        return fail(EvalErrorCode::MismatchedParentheses, start);
+                    }
+                    if (expression_[position_] == ';') {
+                        return fail(EvalErrorCode::UnexpectedSeparator, position_);
+                    }
+                    ++position_;
+                    if (negative) {
+                        output_.push_back({Token::Type::Negation});
+                    }
+                    return true;
+                case CharacterClass::RightParenthesis:
+                case CharacterClass::Separator:
+                    return fail(EvalErrorCode::NotEnoughOperands, start);
+                case CharacterClass::Space:
+                case CharacterClass::Invalid:
+                    return fail(EvalErrorCode::InvalidOperator, start);
+            }
+        }
+    }
+
+    std::string_view expression_;
+    Output& output_;
+    std::size_t max_nesting_;
+    std::size_t nesting_ = 0;
+    std::size_t position_ = 0;
+    EvalError error_{EvalErrorCode::EmptyExpression};
+};
+
+// converts an expression from infix to postfix notation into buffers.output with a Pratt parser, producing the same
+// tokens and errors as infix_to_postfix in linear time, recursion is bounded by rejecting expressions nesting
+// parentheses or right associative operators deeper than max_nesting
+template<typename Allocator>
+constexpr std::expected<void, EvalError> pratt_to_postfix(std::string_view expression, BasicPostfixBuffers<Allocator>& buffers,
+                                                          std::size_t max_nesting = default_max_nesting) {
+    return PrattParser(expression, buffers.output, max_nesting).parse();
+}
+
+// converts expression from infix to postfix notation with a Pratt parser, throws EvaluationError if it is malformed
+// or nested deeper than max_nesting
+std::vector<Token> pratt_to_postfix(std::string_view expression, std::size_t max_nesting = default_max_nesting);
+
+// raises base to an integral exponent during constant evaluation, where std::pow is not available,
+// exact whenever the result is representable
+constexpr double constant_integer_pow(double base, double exponent) {
+    if (exponent != static_cast<double>(static_cast<long long>(exponent)) || exponent > 1e18 || exponent < -1e18) {
+        throw std::runtime_error("Only integral exponents can be evaluated at compile time");
+    }
+    auto remaining = static_cast<long long>(exponent);
+    const bool reciprocal = remaining < 0;
+    double result = 1.0;
+    for (remaining = reciprocal ? -remaining : remaining; remaining > 0; remaining >>= 1) {
+        if (remaining & 1) {
+            result *= base;
+        }
+        base *= base;
+    }
+    return reciprocal ? 1.0 / result : result;
+}
+
+// checks whether an integer raised to a non-negative integral exponent stays an exactly representable integer
+constexpr bool is_exact_integer_pow(double base, double exponent) {
+    constexpr double max_exact = 9007199254740992.0; // 2^53
+    if (base != static_cast<double>(static_cast<long long>(base)) || base > max_exact || base < -max_exact ||
+        exponent != static_cast<double>(static_cast<long long>(exponent)) || exponent < 0.0 || exponent > 64.0) {
+        return false;
+    }
+    double result = 1.0;
+    for (int i = 0; i < static_cast<int>(exponent) && result != 0.0; ++i) {
+        result *= base;
+        if (result > max_exact || result < -max_exact) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// applies an operation on two operands without checking for division by zero, num2 being the left hand side
+constexpr double apply_arithmetic(Operator op, double num2, double num1) {
+    switch(op) {
+        case Operator::Addition:
+            return num2+num1;
+        case Operator::Subtraction:
+            return num2-num1;
+        case Operator::Multiplication:
+            return num2*num1;
+        case Operator::Division:
+            return num2/num1;
+        case Operator::Exponentiation:
+            if consteval {
+                return constant_integer_pow(num2, num1);
+            } else {
+                return std::pow(num2, num1);
+            }
+        default:
+            throw std::runtime_error("Invalid Operator enum value");
+    }
+}
+
+// applies an operation on two operands, num2 being the left hand side
+double apply_operator(Operator op, double num2, double num1);
 
 // applies an operation on the first two top operands from the result stack
 void apply_operator(std::stack<double>& result, Operator op);
 
-// converts an expression to postfix notation and then evaluates it
-double evaluate(const std::string& expression);
+// arithmetic of a value type programs are evaluated in, specialized for double, float and FixedPoint,
+// constants of a program are parsed as doubles and converted with from_double
+template<typename Value>
+struct NumericTraits;
+
+template<>
+struct NumericTraits<double> {
+    static constexpr std::expected<double, EvalErrorCode> from_double(double value) { return value; }
+    static constexpr double to_double(double value) { return value; }
+
+    // applies an operation, fails only on a division by zero
+    static constexpr std::expected<double, EvalErrorCode> apply(Operator op, double lhs, double rhs) {
+        if (op == Operator::Division && rhs == 0.0) {
+            return std::unexpected(EvalErrorCode::DivisionByZero);
+        }
+        return apply_arithmetic(op, lhs, rhs);
+    }
+};
+
+// single precision, every operation rounds to float so results match a float implementation
+template<>
+struct NumericTraits<float> {
+    static constexpr std::expected<float, EvalErrorCode> from_double(double value) { return static_cast<float>(value); }
+    static constexpr double to_double(float value) { return value; }
+
+    // applies an operation, fails only on a division by zero
+    static std::expected<float, EvalErrorCode> apply(Operator op, float lhs, float rhs) {
+        switch (op) {
+            case Operator::Addition:
+                return lhs + rhs;
+            case Operator::Subtraction:
+                return lhs - rhs;
+            case Operator::Multiplication:
+                return lhs * rhs;
+            case Operator::Division:
+                if (rhs == 0.0f) {
+                    return std::unexpected(EvalErrorCode::DivisionByZero);
+                }
+                return lhs / rhs;
+            case Operator::Exponentiation:
+                return std::pow(lhs, rhs);
+        }
+        throw std::runtime_error("Invalid Operator enum value");
+    }
+};
+
+// calls a function on arguments of any value type, functions compute in double, so other types are
+// converted there and back
+template<typename Value>
+constexpr std::expected<Value, EvalErrorCode> call_function(const FunctionDefinition& function, const Value* arguments) {
+    if constexpr (std::is_same_v<Value, double>) {
+        return function.scalar(arguments);
+    } else {
+        std::array<double, max_function_arity> converted{};
+        for (std::size_t k = 0; k < function.arity; ++k) {
+            converted[k] = NumericTraits<Value>::to_double(arguments[k]);
+        }
+        return NumericTraits<Value>::from_double(function.scalar(converted.data()));
+    }
+}
+
+// a single step of a compiled postfix program
+struct Instruction {
+    enum class Type {
+        Number,
+        Variable,
+        Operator,
+        Store, // copies the top operand to stack[slot] without popping it
+        Load, // pushes stack[slot] written by an earlier Store
+        Call, // replaces the arity operands on top of the stack by the result of function slot
+    };
+
+    Type type;
+    double value = 0.0; // operand pushed by Type::Number
+    Operator op = {}; // operation applied by Type::Operator
+    std::size_t slot = 0; // binding index read by Type::Variable, stack index of Type::Store and Type::Load, function id of Type::Call
+};
+
+// validates a program and returns the stack depth it needs, temporaries written by Store live above
+// the operands, so their slots must not be lower than the deepest operand
+constexpr std::expected<std::size_t, EvalError> program_stack_depth(std::span<const Instruction> program, std::size_t variable_count) {
+    std::size_t depth = 0;
+    std::size_t max_depth = 0;
+    std::size_t frame = 0;
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Operator:
+                if (depth < 2) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands});
+                }
+                --depth;
+                break;
+            case Instruction::Type::Call: {
+                if (instruction.slot >= function_count()) {
+                    return std::unexpected(EvalError{EvalErrorCode::UnknownFunction});
+                }
+                const std::size_t arity = function_definition(instruction.slot).arity;
+                if (depth < arity) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands});
+                }
+                depth -= arity - 1;
+                break;
+            }
+            case Instruction::Type::Variable:
+                if (instruction.slot >= variable_count) {
+                    return std::unexpected(EvalError{EvalErrorCode::InvalidVariableSlot});
+                }
+                max_depth = std::max(max_depth, ++depth);
+                break;
+            case Instruction::Type::Store:
+                if (depth < 1) {
+                    return std::unexpected(EvalError{EvalErrorCode::NotEnoughOperands});
+                }
+                frame = std::max(frame, instruction.slot + 1);
+                break;
+            case Instruction::Type::Load:
+                frame = std::max(frame, instruction.slot + 1);
+                max_depth = std::max(max_depth, ++depth);
+                break;
+            case Instruction::Type::Number:
+                max_depth = std::max(max_depth, ++depth);
+                break;
+        }
+    }
+
+    if (depth != 1) {
+        return std::unexpected(EvalError{depth == 0 ? EvalErrorCode::EmptyExpression : EvalErrorCode::TooManyOperands});
+    }
+    if (frame == 0) {
+        return max_depth;
+    }
+
+    // every temporary is loaded only after it was stored, and clear of the operands
+    std::vector<bool> stored(frame);
+    for (const Instruction& instruction : program) {
+        if (instruction.type != Instruction::Type::Store && instruction.type != Instruction::Type::Load) {
+            continue;
+        }
+        if (instruction.slot < max_depth || (instruction.type == Instruction::Type::Load && !stored[instruction.slot])) {
+            return std::unexpected(EvalError{EvalErrorCode::InvalidTemporarySlot});
+        }
+        stored[instruction.slot] = true;
+    }
+    return std::max(max_depth, frame);
+}
+
+// runs a validated program on a stack with room for program_stack_depth() operands, in the value type of the stack,
+// doubles skip the checked conversions and arithmetic of the other types, which cannot fold away here since the
+// operator is only known at runtime
+template<typename Value>
+constexpr std::expected<Value, EvalError> run_program(std::span<const Instruction> program, std::span<const std::type_identity_t<Value>> bindings,
+                                                      Value* stack) {
+    using Arithmetic = NumericTraits<Value>;
+    std::size_t top = 0;
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+                if constexpr (std::is_same_v<Value, double>) {
+                    stack[top++] = instruction.value;
+                } else {
+                    const auto value = Arithmetic::from_double(instruction.value);
+                    if (!value) {
+                        return std::unexpected(EvalError{value.error()});
+                    }
+                    stack[top++] = *value;
+                }
+                break;
+            case Instruction::Type::Variable:
+                stack[top++] = bindings[instruction.slot];
+                break;
+            case Instruction::Type::Operator:
+                --top;
+                if constexpr (std::is_same_v<Value, double>) {
+                    if (instruction.op == Operator::Division && stack[top] == 0.0) {
+                        return std::unexpected(EvalError{EvalErrorCode::DivisionByZero});
+                    }
+                    stack[top - 1] = apply_arithmetic(instruction.op, stack[top - 1], stack[top]);
+                } else {
+                    const auto result = Arithmetic::apply(instruction.op, stack[top - 1], stack[top]);
+                    if (!result) {
+                        return std::unexpected(EvalError{result.error()});
+                    }
+                    stack[top - 1] = *result;
+                }
+                break;
+            case Instruction::Type::Call: {
+                const FunctionDefinition& function = function_definition(instruction.slot);
+                top -= function.arity;
+                const auto result = call_function(function, stack + top);
+                if (!result) {
+                    return std::unexpected(EvalError{result.error()});
+                }
+                stack[top++] = *result;
+                break;
+            }
+            case Instruction::Type::Store:
+                stack[instruction.slot] = stack[top - 1];
+                break;
+            case Instruction::Type::Load:
+                stack[top++] = stack[instruction.slot];
+                break;
+        }
+    }
+    return stack[0];
+}
+
+// appends the instructions of a postfix expression to program, resolving variables to slots,
+// variables missing from slots are either appended or rejected
+constexpr std::expected<void, EvalError> append_instructions(std::string_view expression, std::span<const Token> postfix,
+                                                             std::vector<std::string>& slots, bool add_unknown_variables,
+                                                             std::vector<Instruction>& program) {
+    for (const Token& token : postfix) {
+        switch (token.type) {
+            case Token::Type::Number:
+                program.push_back({Instruction::Type::Number, token.value});
+                break;
+            case Token::Type::Variable: {
+                const std::string_view name = expression.substr(token.position, token.length);
+
+                auto it = std::find(slots.begin(), slots.end(), name);
+                if (it == slots.end()) {
+                    if (!add_unknown_variables) {
+                        return std::unexpected(EvalError{EvalErrorCode::UnknownVariable, token.position, token.length});
+                    }
+                    it = slots.emplace(slots.end(), name);
+                }
+                program.push_back({Instruction::Type::Variable, 0.0, {}, static_cast<std::size_t>(it - slots.begin())});
+                break;
+            }
+            case Token::Type::Operator:
+                program.push_back({Instruction::Type::Operator, 0.0, token.op});
+                break;
+            case Token::Type::Call:
+                program.push_back({Instruction::Type::Call, 0.0, {}, token.function});
+                break;
+            case Token::Type::Negation:
+                // unary minus on a variable or parenthesis is compiled as a multiplication by -1
+                program.push_back({Instruction::Type::Number, -1.0});
+                program.push_back({Instruction::Type::Operator, 0.0, Operator::Multiplication});
+                break;
+            case Token::Type::LeftParenthesis:
+            case Token::Type::Function:
+                return std::unexpected(EvalError{EvalErrorCode::MismatchedParentheses, token.position, 1});
+        }
+    }
+    return {};
+}
+
+// folds constant subexpressions, drops identity operations (x*1, x+(-0), x-0, x^1, ...) and rewrites x^2 as x*x,
+// x+0 is kept since -0+0 is +0,
+// division by a constant zero is kept so the program still reports it when evaluated, during constant
+// evaluation only exponentiations with an exact integer result are folded and calls are not, so the others
+// round as at runtime, programs evaluated in another value type than double keep their constant operations
+// unless fold_constants, their arithmetic rounds differently
+constexpr void optimize_program(std::vector<Instruction>& program, bool fold_constants = true) {
+    std::vector<Instruction> optimized;
+    optimized.reserve(program.size());
+    // start of the instructions that compute each operand on the stack
+    std::vector<std::size_t> operands;
+
+    // checks whether the instructions in [begin, end) are a single number
+    const auto is_constant = [&optimized](std::size_t begin, std::size_t end) {
+        return end - begin == 1 && optimized[begin].type == Instruction::Type::Number;
+    };
+    // checks whether the instructions in [begin, end) are a single number equal to value
+    const auto is_constant_value = [&](std::size_t begin, std::size_t end, double value) {
+        return is_constant(begin, end) && optimized[begin].value == value;
+    };
+    // checks whether the instructions in [begin, end) are a single zero of the given sign, the only addend
+    // and subtrahend leaving every operand unchanged, signed zeros included
+    const auto is_signed_zero = [&](std::size_t begin, std::size_t end, bool negative) {
+        return is_constant_value(begin, end, 0.0) && (std::bit_cast<std::uint64_t>(optimized[begin].value) >> 63) == negative;
+    };
+    // checks whether the instructions in [begin, end) push a single operand without computing anything
+    const auto is_single_load = [&optimized](std::size_t begin, std::size_t end) {
+        return end - begin == 1 && optimized[begin].type != Instruction::Type::Operator && optimized[begin].type != Instruction::Type::Store;
+    };
+
+    for (const Instruction& instruction : program) {
+        if (instruction.type == Instruction::Type::Store) {
+            optimized.push_back(instruction); // keeps the operand it copies a single one
+            continue;
+        }
+        if (instruction.type == Instruction::Type::Call) {
+            const bool known = instruction.slot < function_count();
+            const std::size_t arity = known ? function_definition(instruction.slot).arity : 0;
+            if (!known || operands.size() < arity) {
+                return; // left for validation to report
+            }
+
+            // the call replaces its arguments as an operand starting where the first one starts
+            const std::size_t first = operands[operands.size() - arity];
+            operands.resize(operands.size() - arity + 1);
+            bool constant = fold_constants && optimized.size() - first == arity;
+            for (std::size_t i = first; i < optimized.size(); ++i) {
+                constant = constant && optimized[i].type == Instruction::Type::Number;
+            }
+            if consteval {
+                constant = false;
+            }
+            if (constant) {
+                std::array<double, max_function_arity> arguments{};
+                for (std::size_t k = 0; k < arity; ++k) {
+                    arguments[k] = optimized[first + k].value;
+                }
+                optimized.resize(first);
+                optimized.push_back({Instruction::Type::Number, function_definition(instruction.slot).scalar(arguments.data())});
+            } else {
+                optimized.push_back(instruction);
+            }
+            continue;
+        }
+        if (instruction.type != Instruction::Type::Operator) {
+            operands.push_back(optimized.size());
+            optimized.push_back(instruction);
+            continue;
+        }
+        if (operands.size() < 2) {
+            return; // left for validation to report
+        }
+
+        const std::size_t rhs = operands.back();
+        operands.pop_back();
+        const std::size_t lhs = operands.back();
+        const std::size_t end = optimized.size();
+        const Operator op = instruction.op;
+
+        bool foldable = fold_constants;
+        if consteval {
+            foldable = foldable && (op != Operator::Exponentiation || is_exact_integer_pow(optimized[lhs].value, optimized[rhs].value));
+        }
+        if (is_constant(lhs, rhs) && is_constant(rhs, end)) {
+            // division by a constant zero is left in place so it still fails when evaluated
+            if (foldable && (op != Operator::Division || optimized[rhs].value != 0.0)) {
+                optimized[lhs].value = apply_arithmetic(op, optimized[lhs].value, optimized[rhs].value);
+                optimized.pop_back();
+                continue;
+            }
+        } else if ((is_constant_value(rhs, end, 1.0) &&
+                    (op == Operator::Multiplication || op == Operator::Division || op == Operator::Exponentiation)) ||
+                   (is_signed_zero(rhs, end, true) && op == Operator::Addition) ||
+                   (is_signed_zero(rhs, end, false) && op == Operator::Subtraction)) {
+            // x*1, x/1, x^1, x+(-0) and x-0
+            optimized.pop_back();
+            continue;
+        } else if ((is_constant_value(lhs, rhs, 1.0) && op == Operator::Multiplication) ||
+                   (is_signed_zero(lhs, rhs, true) && op == Operator::Addition)) {
+            // 1*x and (-0)+x
+            optimized.erase(optimized.begin() + static_cast<std::ptrdiff_t>(lhs));
+            continue;
+        } else if (op == Operator::Exponentiation && is_constant_value(rhs, end, 2.0) && is_single_load(lhs, rhs)) {
+            // x^2 as x*x, pow() and a single multiplication round the same way
+            optimized[rhs] = optimized[lhs];
+            optimized.push_back({Instruction::Type::Operator, 0.0, Operator::Multiplication});
+            continue;
+        }
+        optimized.push_back(instruction);
+    }
+
+    if (operands.size() == 1) {
+        program = std::move(optimized);
+    }
+}
+
+// optimizes and runs a program on one binding, for checking the identities at compile time
+constexpr double optimized_result(std::vector<Instruction> program, double binding) {
+    optimize_program(program);
+    std::array<double, 4> stack{};
+    return *run_program<double>(program, std::span(&binding, 1), stack.data());
+}
+
+constexpr bool is_negative_zero(double value) {
+    return value == 0.0 && (std::bit_cast<std::uint64_t>(value) >> 63) != 0;
+}
+
+// -0+0 is +0, so x+0 and 0+x must stay additions, while x+(-0), (-0)+x and x-0 leave -0 unchanged
+static_assert(!is_negative_zero(optimized_result({{Instruction::Type::Variable}, {Instruction::Type::Number, 0.0},
+                                                  {Instruction::Type::Operator, 0.0, Operator::Addition}}, -0.0)));
+static_assert(!is_negative_zero(optimized_result({{Instruction::Type::Number, 0.0}, {Instruction::Type::Variable},
+                                                  {Instruction::Type::Operator, 0.0, Operator::Addition}}, -0.0)));
+static_assert(!is_negative_zero(optimized_result({{Instruction::Type::Variable}, {Instruction::Type::Number, -0.0},
+                                                  {Instruction::Type::Operator, 0.0, Operator::Subtraction}}, -0.0)));
+static_assert(is_negative_zero(optimized_result({{Instruction::Type::Variable}, {Instruction::Type::Number, -0.0},
+                                                 {Instruction::Type::Operator, 0.0, Operator::Addition}}, -0.0)));
+static_assert(is_negative_zero(optimized_result({{Instruction::Type::Number, -0.0}, {Instruction::Type::Variable},
+                                                 {Instruction::Type::Operator, 0.0, Operator::Addition}}, -0.0)));
+static_assert(is_negative_zero(optimized_result({{Instruction::Type::Variable}, {Instruction::Type::Number, 0.0},
+                                                 {Instruction::Type::Operator, 0.0, Operator::Subtraction}}, -0.0)));
+
+// x^2 becomes x*x and keeps its value
+static_assert([] {
+    std::vector<Instruction> program{{Instruction::Type::Variable}, {Instruction::Type::Number, 2.0},
+                                     {Instruction::Type::Operator, 0.0, Operator::Exponentiation}};
+    optimize_program(program);
+    return program.size() == 3 && program[1].type == Instruction::Type::Variable && program[2].op == Operator::Multiplication;
+}());
+static_assert(optimized_result({{Instruction::Type::Variable}, {Instruction::Type::Number, 2.0},
+                                {Instruction::Type::Operator, 0.0, Operator::Exponentiation}}, -3.0) == 9.0);
+
+class JitFunction;
+class JitTier;
+template<typename Value>
+class BasicRegisterProgram;
+using RegisterProgram = BasicRegisterProgram<double>;
+
+// expression parsed once into a typed postfix program and translated to register bytecode, evaluated without
+// any string handling, hot programs are evaluated through native code generated once JitTier::threshold
+// evaluations were recorded
+//
+// immutable after construction apart from the thread safe tier-up state, so one instance may be evaluated
+// from any number of threads at once
+class CompiledExpression {
+public:
+    // stack depth up to which eval() runs on a local buffer instead of allocating
+    static constexpr std::size_t inline_stack_depth = 64;
+
+    // validates the program, throws if it does not leave exactly one operand on the stack
+    explicit CompiledExpression(std::vector<Instruction> program, std::vector<std::string> variables = {});
+
+    // validates the program, returns an error if it does not leave exactly one operand on the stack
+    static std::expected<CompiledExpression, EvalError> create(std::vector<Instruction> program, std::vector<std::string> variables = {});
+
+    // evaluates the compiled program, only valid for expressions without variables
+    double eval() const;
+
+    // evaluates the compiled program with bindings[slot] as the value of each variable
+    double eval(std::span<const double> bindings) const;
+
+    // evaluates the compiled program with bindings[slot] as the value of each variable without throwing
+    std::expected<double, EvalError> try_eval(std::span<const double> bindings = {}) const;
+
+    // returns the slot index of a variable, throws if the expression does not use it
+    std::size_t slot(std::string_view name) const;
+
+    const std::vector<Instruction>& program() const { return program_; }
+    const std::vector<std::string>& variables() const { return variables_; }
+    std::size_t max_stack_depth() const { return max_stack_depth_; }
+
+    // records evaluations done by the caller, returns the native code once the program got hot and nullptr until then
+    const JitFunction* native_code(std::size_t evaluations) const;
+
+    // bytecode run by eval() until native code exists, nullptr for programs too large to encode
+    const RegisterProgram* register_program() const { return register_program_.get(); }
+
+private:
+    CompiledExpression(std::vector<Instruction> program, std::vector<std::string> variables, std::size_t max_stack_depth);
+
+    std::vector<Instruction> program_;
+    std::vector<std::string> variables_;
+    std::size_t max_stack_depth_ = 0;
+    std::shared_ptr<const RegisterProgram> register_program_; // shared by copies, they hold the same program
+    std::shared_ptr<JitTier> jit_tier_;
+};
+
+// compiles an expression whose variables get slots in the order they first appear
+CompiledExpression compile(std::string_view expression);
+
+// compiles an expression whose variables are bound to the slots given by their position in variables
+CompiledExpression compile(std::string_view expression, std::span<const std::string> variables);
+
+// converts an expression to postfix notation and captures it as a compiled program,
+// variables missing from the given list are either appended or rejected
+CompiledExpression compile(std::string_view expression, std::span<const std::string> variables, bool add_unknown_variables);
+
+// compiles an expression whose variables get slots in the order they first appear without throwing
+std::expected<CompiledExpression, EvalError> try_compile(std::string_view expression);
+
+// compiles an expression whose variables are bound to the slots given by their position in variables without throwing
+std::expected<CompiledExpression, EvalError> try_compile(std::string_view expression, std::span<const std::string> variables);
+
+// converts an expression to postfix notation and captures it as a compiled program without throwing,
+// variables missing from the given list are either appended or rejected, programs for other value types
+// than double are compiled without fold_constants
+std::expected<CompiledExpression, EvalError> try_compile(std::string_view expression, std::span<const std::string> variables,
+                                                         bool add_unknown_variables, bool fold_constants = true);
+
+// converts an expression to postfix notation and then evaluates it,
+// repeated calls reuse per thread buffers and do not allocate
+double evaluate(std::string_view expression);
+
+// converts an expression to postfix notation and then evaluates it without throwing, a variable is an
+// UnknownVariable error at its position, repeated calls reuse per thread buffers and do not allocate
+std::expected<double, EvalError> try_evaluate(std::string_view expression);
 
 #endif //EXPRESSION_EVALUATOR_HPP
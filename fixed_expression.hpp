@@ -0,0 +1,195 @@
+#ifndef FIXED_EXPRESSION_HPP
+#define FIXED_EXPRESSION_HPP
+
+#include "expression_evaluator.hpp"
+
+#include <type_traits>
+#include <utility>
+
+// string literal usable as a template argument
+template<std::size_t N>
+struct FixedString {
+    char text[N] = {};
+
+    constexpr FixedString(const char (&literal)[N]) {
+        std::copy_n(literal, N, text);
+    }
+
+    constexpr std::string_view view() const { return {text, N - 1}; }
+};
+
+// reached only while compiling a malformed fixed expression, stops the constant evaluation there
+void fixed_expression_error(EvalErrorCode code, std::size_t position);
+
+// program of a fixed expression as built during constant evaluation
+struct FixedProgram {
+    std::vector<Instruction> program;
+    std::vector<std::string_view> variables; // views into the expression text
+    std::size_t max_stack_depth = 0;
+};
+
+// compiles the text of a fixed expression, variables get slots in the order they first appear
+constexpr FixedProgram compile_fixed_program(std::string_view text) {
+    PostfixBuffers buffers;
+    if (const auto result = infix_to_postfix(text, buffers); !result) {
+        fixed_expression_error(result.error().code, result.error().position);
+    }
+
+    FixedProgram fixed;
+    std::vector<std::string> slots;
+    if (const auto result = append_instructions(text, buffers.output, slots, true, fixed.program); !result) {
+        fixed_expression_error(result.error().code, result.error().position);
+    }
+    optimize_program(fixed.program);
+
+    const auto depth = program_stack_depth(fixed.program, slots.size());
+    if (!depth) {
+        fixed_expression_error(depth.error().code, depth.error().position);
+    }
+    fixed.max_stack_depth = *depth;
+
+    // names are taken from their first token so they outlive the transient slot strings
+    for (const std::string& slot : slots) {
+        for (const Token& token : buffers.output) {
+            if (token.type == Token::Type::Variable && text.substr(token.position, token.length) == slot) {
+                fixed.variables.push_back(text.substr(token.position, token.length));
+                break;
+            }
+        }
+    }
+    return fixed;
+}
+
+// expression parsed, validated and optimized during compilation, malformed text is a compile error,
+// evaluation runs code specialized for every instruction with stack positions known at compile time
+template<FixedString Text>
+class FixedExpression {
+    // sizes of the program, its variables and its stack
+    static constexpr std::array<std::size_t, 3> sizes = [] {
+        const FixedProgram fixed = compile_fixed_program(Text.view());
+        return std::array<std::size_t, 3>{fixed.program.size(), fixed.variables.size(), fixed.max_stack_depth};
+    }();
+
+public:
+    static constexpr std::string_view text = Text.view();
+
+    static constexpr std::array<Instruction, sizes[0]> program = [] {
+        const FixedProgram fixed = compile_fixed_program(Text.view());
+        std::array<Instruction, sizes[0]> program{};
+        std::copy(fixed.program.begin(), fixed.program.end(), program.begin());
+        return program;
+    }();
+
+    static constexpr std::array<std::string_view, sizes[1]> variables = [] {
+        const FixedProgram fixed = compile_fixed_program(Text.view());
+        std::array<std::string_view, sizes[1]> variables{};
+        std::copy(fixed.variables.begin(), fixed.variables.end(), variables.begin());
+        return variables;
+    }();
+
+    static constexpr std::size_t max_stack_depth = sizes[2];
+
+    // evaluates the expression with bindings[slot] as the value of each variable
+    constexpr double eval(std::span<const double> bindings = {}) const {
+        const auto result = try_eval(bindings);
+        if (!result) {
+            throw EvaluationError(result.error(), text);
+        }
+        return *result;
+    }
+
+    // evaluates the expression with the values of its variables given in slot order
+    template<typename... Values>
+        requires (sizeof...(Values) == sizes[1] && (std::is_convertible_v<Values, double> && ...))
+    constexpr double operator()(Values... values) const {
+        const std::array<double, sizeof...(Values)> bindings{static_cast<double>(values)...};
+        return eval(bindings);
+    }
+
+    // evaluates the expression with bindings[slot] as the value of each variable without throwing
+    constexpr std::expected<double, EvalError> try_eval(std::span<const double> bindings = {}) const {
+        if (bindings.size() < variables.size()) {
+            return std::unexpected(EvalError{EvalErrorCode::NotEnoughBindings});
+        }
+
+        std::array<double, max_stack_depth> stack{};
+        if (!run(bindings, stack.data(), std::make_index_sequence<program.size()>())) {
+            return std::unexpected(EvalError{EvalErrorCode::DivisionByZero});
+        }
+        return stack[0];
+    }
+
+    // returns the slot index of a variable, throws if the expression does not use it
+    static constexpr std::size_t slot(std::string_view name) {
+        const auto it = std::find(variables.begin(), variables.end(), name);
+        if (it == variables.end()) {
+            throw std::runtime_error("Unknown variable: " + std::string(name));
+        }
+        return static_cast<std::size_t>(it - variables.begin());
+    }
+
+    // the same program as a runtime CompiledExpression, e.g. for batch evaluation
+    static CompiledExpression compile() {
+        return CompiledExpression(std::vector<Instruction>(program.begin(), program.end()),
+                                  std::vector<std::string>(variables.begin(), variables.end()));
+    }
+
+private:
+    // stack height before each instruction
+    static constexpr std::array<std::size_t, sizes[0]> tops = [] {
+        std::array<std::size_t, sizes[0]> tops{};
+        std::size_t top = 0;
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            tops[i] = top;
+            if (program[i].type == Instruction::Type::Operator) {
+                --top;
+            } else if (program[i].type == Instruction::Type::Call) {
+                top -= builtin_functions[program[i].slot].arity - 1;
+            } else if (program[i].type != Instruction::Type::Store) {
+                ++top;
+            }
+        }
+        return tops;
+    }();
+
+    // runs every instruction in order, stops at a division by zero
+    template<std::size_t... I>
+    static constexpr bool run(std::span<const double> bindings, double* stack, std::index_sequence<I...>) {
+        return (step<I>(bindings, stack) && ...);
+    }
+
+    // runs instruction I, returns false on a division by zero
+    template<std::size_t I>
+    static constexpr bool step(std::span<const double> bindings, double* stack) {
+        constexpr Instruction instruction = program[I];
+        constexpr std::size_t top = tops[I];
+
+        if constexpr (instruction.type == Instruction::Type::Number) {
+            stack[top] = instruction.value;
+        } else if constexpr (instruction.type == Instruction::Type::Variable) {
+            stack[top] = bindings[instruction.slot];
+        } else if constexpr (instruction.type == Instruction::Type::Store) {
+            stack[instruction.slot] = stack[top - 1];
+        } else if constexpr (instruction.type == Instruction::Type::Load) {
+            stack[top] = stack[instruction.slot];
+        } else if constexpr (instruction.type == Instruction::Type::Call) {
+            // only built-ins are found while compiling, so the call is bound here
+            constexpr FunctionDefinition function = builtin_functions[instruction.slot];
+            stack[top - function.arity] = function.scalar(stack + top - function.arity);
+        } else {
+            if constexpr (instruction.op == Operator::Division) {
+                if (stack[top - 1] == 0.0) {
+                    return false;
+                }
+            }
+            stack[top - 2] = apply_arithmetic(instruction.op, stack[top - 2], stack[top - 1]);
+        }
+        return true;
+    }
+};
+
+// fixed expression compiled along with the program, e.g. expr<"2*(x+1)">(3.0) or static_assert(expr<"2^10">.eval() == 1024)
+template<FixedString Text>
+constexpr FixedExpression<Text> expr{};
+
+#endif //FIXED_EXPRESSION_HPP
@@ -0,0 +1,147 @@
+#ifndef FIXED_POINT_HPP
+#define FIXED_POINT_HPP
+
+#include "expression_evaluator.hpp"
+
+#include <compare>
+#include <optional>
+
+// products and quotients are computed on 128 bit integers, which GCC and Clang provide
+#if defined(__SIZEOF_INT128__)
+#define EXPRESSION_EVALUATOR_HAVE_FIXED_POINT
+
+// signed decimal fixed point number of 64 bits with Decimals digits after the point, e.g. for money,
+// sums and differences are exact, products and quotients are rounded half away from zero to the last digit
+template<int Decimals>
+class FixedPoint {
+public:
+    static_assert(Decimals >= 0 && Decimals <= 18);
+
+    // raw value of 1
+    static constexpr std::int64_t scale = [] {
+        std::int64_t scale = 1;
+        for (int i = 0; i < Decimals; ++i) {
+            scale *= 10;
+        }
+        return scale;
+    }();
+
+    constexpr FixedPoint() = default;
+
+    // value of raw / scale
+    static constexpr FixedPoint from_raw(std::int64_t raw) {
+        FixedPoint value;
+        value.raw_ = raw;
+        return value;
+    }
+
+    // nearest value to a double, std::nullopt if it is out of range or not a number
+    static constexpr std::optional<FixedPoint> from_double(double value) {
+        const double scaled = value * static_cast<double>(scale);
+        // both bounds are powers of two, so they are exact doubles
+        if (!(scaled >= -0x1p63 && scaled < 0x1p63)) {
+            return std::nullopt;
+        }
+        return from_raw(static_cast<std::int64_t>(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5));
+    }
+
+    constexpr std::int64_t raw() const { return raw_; }
+    constexpr double to_double() const { return static_cast<double>(raw_) / static_cast<double>(scale); }
+
+    constexpr auto operator<=>(const FixedPoint&) const = default;
+
+private:
+    std::int64_t raw_ = 0;
+};
+
+// six decimals, values up to about 9.2e12
+using Fixed64 = FixedPoint<6>;
+
+template<int Decimals>
+struct NumericTraits<FixedPoint<Decimals>> {
+    using Value = FixedPoint<Decimals>;
+
+    static constexpr std::expected<Value, EvalErrorCode> from_double(double value) {
+        if (const auto result = Value::from_double(value)) {
+            return *result;
+        }
+        return std::unexpected(EvalErrorCode::NotRepresentable);
+    }
+    static constexpr double to_double(Value value) { return value.to_double(); }
+
+    // applies an operation, fails on a division by zero and on results out of range, integral exponents
+    // are computed by repeated multiplication rounded at every step, others through double
+    static constexpr std::expected<Value, EvalErrorCode> apply(Operator op, Value lhs, Value rhs) {
+        std::int64_t result = 0;
+        switch (op) {
+            case Operator::Addition:
+                if (__builtin_add_overflow(lhs.raw(), rhs.raw(), &result)) {
+                    return std::unexpected(EvalErrorCode::NotRepresentable);
+                }
+                return Value::from_raw(result);
+            case Operator::Subtraction:
+                if (__builtin_sub_overflow(lhs.raw(), rhs.raw(), &result)) {
+                    return std::unexpected(EvalErrorCode::NotRepresentable);
+                }
+                return Value::from_raw(result);
+            case Operator::Multiplication:
+                return narrow(divide_rounded(static_cast<__int128>(lhs.raw()) * rhs.raw(), Value::scale));
+            case Operator::Division:
+                if (rhs.raw() == 0) {
+                    return std::unexpected(EvalErrorCode::DivisionByZero);
+                }
+                return narrow(divide_rounded(static_cast<__int128>(lhs.raw()) * Value::scale, rhs.raw()));
+            case Operator::Exponentiation:
+                if (rhs.raw() % Value::scale == 0) {
+                    return integer_power(lhs, rhs.raw() / Value::scale);
+                }
+                return from_double(std::pow(lhs.to_double(), rhs.to_double()));
+        }
+        throw std::runtime_error("Invalid Operator enum value");
+    }
+
+private:
+    // quotient rounded half away from zero
+    static constexpr __int128 divide_rounded(__int128 numerator, __int128 denominator) {
+        const __int128 quotient = numerator / denominator;
+        const __int128 remainder = numerator % denominator;
+        const __int128 twice = remainder < 0 ? -2 * remainder : 2 * remainder;
+        if (twice >= (denominator < 0 ? -denominator : denominator)) {
+            return (numerator < 0) == (denominator < 0) ? quotient + 1 : quotient - 1;
+        }
+        return quotient;
+    }
+
+    static constexpr std::expected<Value, EvalErrorCode> narrow(__int128 raw) {
+        if (raw < INT64_MIN || raw > INT64_MAX) {
+            return std::unexpected(EvalErrorCode::NotRepresentable);
+        }
+        return Value::from_raw(static_cast<std::int64_t>(raw));
+    }
+
+    // base^exponent by squaring, negative exponents divide 1 by the power
+    static constexpr std::expected<Value, EvalErrorCode> integer_power(Value base, std::int64_t exponent) {
+        const Value one = Value::from_raw(Value::scale);
+        std::expected<Value, EvalErrorCode> result = one;
+        std::expected<Value, EvalErrorCode> square = base;
+        for (std::uint64_t remaining = exponent < 0 ? -static_cast<std::uint64_t>(exponent) : exponent; remaining != 0; remaining >>= 1) {
+            if (remaining & 1) {
+                result = apply(Operator::Multiplication, *result, *square);
+                if (!result) {
+                    return result;
+                }
+            }
+            if (remaining > 1) {
+                square = apply(Operator::Multiplication, *square, *square);
+                if (!square) {
+                    return square;
+                }
+            }
+        }
+        return exponent < 0 ? apply(Operator::Division, one, *result) : result;
+    }
+};
+
+#endif
+
+#endif //FIXED_POINT_HPP
@@ -0,0 +1,217 @@
+#include "formula_sheet.hpp"
+
+// returns the id of a variable, creating it with the value 0 if the sheet does not know it yet
+std::size_t FormulaSheet::variable(std::string_view name) {
+    if (const auto it = variable_ids_.find(name); it != variable_ids_.end()) {
+        return it->second;
+    }
+    variables_.push_back({std::string(name)});
+    variable_ids_.emplace(std::string(name), variables_.size() - 1);
+    return variables_.size() - 1;
+}
+
+// compiles an expression into the sheet, creating its unknown variables, returns the formula id
+std::size_t FormulaSheet::add_formula(std::string_view expression) {
+    const auto formula = try_add_formula(expression);
+    if (!formula) {
+        throw EvaluationError(formula.error(), expression);
+    }
+    return *formula;
+}
+
+// compiles an expression into the sheet without throwing, the optimized program is merged into the graph
+// so subexpressions already computed for other formulas are shared
+std::expected<std::size_t, EvalError> FormulaSheet::try_add_formula(std::string_view expression) {
+    const auto compiled = try_compile(expression);
+    if (!compiled) {
+        return std::unexpected(compiled.error());
+    }
+
+    // slots of the compiled program in order of first appearance, mapped to the variables of the sheet
+    std::vector<std::size_t> ids;
+    ids.reserve(compiled->variables().size());
+    for (const std::string& name : compiled->variables()) {
+        ids.push_back(variable(name));
+    }
+
+    std::vector<std::uint32_t> operands;
+    std::vector<std::uint32_t> temporaries(compiled->max_stack_depth());
+    for (const Instruction& instruction : compiled->program()) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+                operands.push_back(add_node(instruction));
+                break;
+            case Instruction::Type::Variable: {
+                const Instruction read{Instruction::Type::Variable, 0.0, {}, ids[instruction.slot]};
+                operands.push_back(add_node(read));
+                break;
+            }
+            case Instruction::Type::Operator:
+            case Instruction::Type::Call: {
+                const std::size_t count = instruction.type == Instruction::Type::Operator ? 2 : function_definition(instruction.slot).arity;
+                const std::uint32_t node = add_node(instruction, std::span(operands).last(count));
+                operands.resize(operands.size() - count);
+                operands.push_back(node);
+                break;
+            }
+            case Instruction::Type::Store:
+                temporaries[instruction.slot] = operands.back();
+                break;
+            case Instruction::Type::Load:
+                operands.push_back(temporaries[instruction.slot]);
+                break;
+        }
+    }
+
+    formulas_.push_back(operands.back());
+    return formulas_.size() - 1;
+}
+
+// adds a node to the graph, new nodes start dirty and are registered with their operands
+std::uint32_t FormulaSheet::add_node(const Instruction& instruction, std::span<const std::uint32_t> operands) {
+    std::uint32_t node = 0;
+    switch (instruction.type) {
+        case Instruction::Type::Number:
+            node = dag_.add_number(instruction.value);
+            break;
+        case Instruction::Type::Variable:
+            node = dag_.add_variable(instruction.slot);
+            break;
+        case Instruction::Type::Call:
+            node = dag_.add_call(instruction.slot, operands);
+            break;
+        default:
+            node = dag_.add_operator(instruction.op, operands[0], operands[1]);
+            break;
+    }
+    if (node < states_.size()) {
+        return node;
+    }
+
+    states_.emplace_back();
+    dependents_.emplace_back();
+    NodeState& state = states_.back();
+    if (instruction.type == Instruction::Type::Number) {
+        state = {instruction.value, false, false};
+    } else if (instruction.type == Instruction::Type::Variable) {
+        Variable& variable = variables_[instruction.slot];
+        variable.node = node;
+        state = {variable.value, false, false};
+    } else {
+        // an operand used twice, as in x*x, is registered once
+        for (std::size_t i = 0; i < operands.size(); ++i) {
+            if (std::ranges::find(operands.first(i), operands[i]) == operands.begin() + static_cast<std::ptrdiff_t>(i)) {
+                dependents_[operands[i]].push_back(node);
+            }
+        }
+    }
+    return node;
+}
+
+// changes a variable and marks every node depending on it dirty
+void FormulaSheet::set(std::size_t variable, double value) {
+    Variable& changed = variables_[variable];
+    changed.value = value;
+    if (changed.node == no_node) {
+        return;
+    }
+    states_[changed.node].value = value;
+    invalidate_dependents(changed.node);
+}
+
+void FormulaSheet::set(std::string_view name, double value) {
+    set(this->variable(name), value);
+}
+
+// marks everything depending on a node dirty, a dirty node's dependents are dirty already, so the walk stops there
+void FormulaSheet::invalidate_dependents(std::uint32_t node) {
+    scratch_.assign(dependents_[node].begin(), dependents_[node].end());
+    while (!scratch_.empty()) {
+        const std::uint32_t current = scratch_.back();
+        scratch_.pop_back();
+        if (states_[current].dirty) {
+            continue;
+        }
+        states_[current].dirty = true;
+        scratch_.insert(scratch_.end(), dependents_[current].begin(), dependents_[current].end());
+    }
+}
+
+// returns the value of a formula, recomputing the dirty nodes it depends on
+double FormulaSheet::value(std::size_t formula) {
+    const auto result = try_value(formula);
+    if (!result) {
+        throw EvaluationError(result.error());
+    }
+    return *result;
+}
+
+// returns the value of a formula without throwing
+std::expected<double, EvalError> FormulaSheet::try_value(std::size_t formula) {
+    const std::uint32_t root = formulas_[formula];
+    if (states_[root].dirty) {
+        recompute(root);
+    }
+    if (states_[root].failed) {
+        return std::unexpected(EvalError{EvalErrorCode::DivisionByZero});
+    }
+    return states_[root].value;
+}
+
+// recomputes the dirty nodes a node depends on, clean nodes only have clean operands so the walk stops there,
+// a depth first walk queues each dirty node once and lists it after its operands, so a read costs O(dirty nodes)
+void FormulaSheet::recompute(std::uint32_t node) {
+    const auto& nodes = dag_.nodes();
+
+    if (++epoch_ == 0) {
+        // the epoch wrapped around, older marks could collide with the new ones
+        for (NodeState& state : states_) {
+            state.visited = 0;
+        }
+        epoch_ = 1;
+    }
+    states_[node].visited = epoch_;
+    pending_.assign(1, {node, 0});
+    scratch_.clear();
+    while (!pending_.empty()) {
+        auto& [current, next] = pending_.back();
+        const DagNode& dag_node = nodes[current];
+        // skips clean operands and those queued already, a queued operand is listed before it is needed again
+        while (next < dag_node.operand_count) {
+            const NodeState& operand = states_[dag_node.operands[next]];
+            if (operand.dirty && operand.visited != epoch_) {
+                break;
+            }
+            ++next;
+        }
+        if (next == dag_node.operand_count) {
+            scratch_.push_back(current);
+            pending_.pop_back();
+            continue;
+        }
+        const std::uint32_t operand = dag_node.operands[next++];
+        states_[operand].visited = epoch_;
+        pending_.emplace_back(operand, 0); // invalidates current and next, they are not used again
+    }
+
+    for (const std::uint32_t current : scratch_) {
+        const DagNode& dag_node = nodes[current];
+        NodeState& state = states_[current];
+        state.dirty = false;
+        if (dag_node.type == Instruction::Type::Call) {
+            std::array<double, max_function_arity> arguments{};
+            state.failed = false;
+            for (std::uint32_t i = 0; i < dag_node.operand_count; ++i) {
+                state.failed = state.failed || states_[dag_node.operands[i]].failed;
+                arguments[i] = states_[dag_node.operands[i]].value;
+            }
+            state.value = state.failed ? 0.0 : function_definition(dag_node.slot).scalar(arguments.data());
+            continue;
+        }
+        const NodeState& lhs = states_[dag_node.operands[0]];
+        const NodeState& rhs = states_[dag_node.operands[1]];
+        state.failed = lhs.failed || rhs.failed || (dag_node.op == Operator::Division && rhs.value == 0.0);
+        state.value = state.failed ? 0.0 : apply_arithmetic(dag_node.op, lhs.value, rhs.value);
+    }
+    computed_nodes_ += scratch_.size();
+}
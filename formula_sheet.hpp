@@ -0,0 +1,95 @@
+#ifndef FORMULA_SHEET_HPP
+#define FORMULA_SHEET_HPP
+
+#include "expression_dag.hpp"
+#include "expression_evaluator.hpp"
+
+#include <unordered_map>
+#include <utility>
+
+// set of formulas over shared variables that recomputes only what an update affects
+//
+// all formulas are merged into one expression graph, so a subexpression appearing in several formulas is a
+// single node. Every node caches its value. Setting a variable marks the nodes depending on it dirty, and
+// reading a formula recomputes only its dirty nodes, so a tick costs O(changed dependents), not O(formulas).
+// Not thread safe, reads update the cached values.
+class FormulaSheet {
+public:
+    FormulaSheet() = default;
+    FormulaSheet(const FormulaSheet&) = delete;
+    FormulaSheet& operator=(const FormulaSheet&) = delete;
+
+    // returns the id of a variable, creating it with the value 0 if the sheet does not know it yet
+    std::size_t variable(std::string_view name);
+
+    // compiles an expression into the sheet, creating its unknown variables, returns the formula id,
+    // throws EvaluationError if it is malformed
+    std::size_t add_formula(std::string_view expression);
+
+    // compiles an expression into the sheet without throwing
+    std::expected<std::size_t, EvalError> try_add_formula(std::string_view expression);
+
+    // changes a variable and marks every node depending on it dirty, nothing is recomputed yet
+    void set(std::size_t variable, double value);
+    void set(std::string_view name, double value);
+
+    // returns the value of a formula, recomputing the dirty nodes it depends on, throws EvaluationError on a division by zero
+    double value(std::size_t formula);
+
+    // returns the value of a formula without throwing
+    std::expected<double, EvalError> try_value(std::size_t formula);
+
+    double variable_value(std::size_t variable) const { return variables_[variable].value; }
+    const std::string& variable_name(std::size_t variable) const { return variables_[variable].name; }
+    std::size_t variable_count() const { return variables_.size(); }
+    std::size_t formula_count() const { return formulas_.size(); }
+    std::size_t node_count() const { return dag_.nodes().size(); }
+
+    // nodes computed since the sheet was created, to check how much work updates cause
+    std::size_t computed_nodes() const { return computed_nodes_; }
+
+private:
+    static constexpr std::uint32_t no_node = static_cast<std::uint32_t>(-1);
+
+    struct Variable {
+        std::string name;
+        double value = 0.0;
+        std::uint32_t node = no_node; // graph node reading it, once a formula uses it
+    };
+
+    // cached result of a graph node
+    struct NodeState {
+        double value = 0.0;
+        bool dirty = true;
+        bool failed = false; // divided by zero, here or in an operand
+        std::uint32_t visited = 0; // epoch of the last recompute() that queued it
+    };
+
+    // hashes std::string and std::string_view alike so lookups do not need to build a name
+    struct NameHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+    };
+
+    // adds a node to the graph, new nodes start dirty and are registered with their operands
+    std::uint32_t add_node(const Instruction& instruction, std::span<const std::uint32_t> operands = {});
+
+    // marks a node and everything depending on it dirty, stops at nodes that already are
+    void invalidate_dependents(std::uint32_t node);
+
+    // recomputes the dirty nodes a node depends on, operands before their users, each of them once
+    void recompute(std::uint32_t node);
+
+    ExpressionDag dag_;
+    std::vector<NodeState> states_; // indexed like dag_.nodes()
+    std::vector<std::vector<std::uint32_t>> dependents_; // nodes using each node as an operand
+    std::vector<Variable> variables_;
+    std::unordered_map<std::string, std::size_t, NameHash, std::equal_to<>> variable_ids_;
+    std::vector<std::uint32_t> formulas_; // root node of each formula
+    std::vector<std::uint32_t> scratch_; // reused by invalidate_dependents and recompute
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pending_; // node and next operand to visit, reused by recompute
+    std::uint32_t epoch_ = 0; // of the current recompute(), nodes queued by it carry it in visited
+    std::size_t computed_nodes_ = 0;
+};
+
+#endif //FORMULA_SHEET_HPP
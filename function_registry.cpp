@@ -0,0 +1,113 @@
+#include "function_registry.hpp"
+#include "expression_evaluator.hpp"
+#include "simd_kernels.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// built-ins are placed by constant initialization, so calls made during static initialization see them
+constexpr std::array<FunctionDefinition, max_functions> initial_functions() {
+    std::array<FunctionDefinition, max_functions> functions{};
+    std::copy(builtin_functions.begin(), builtin_functions.end(), functions.begin());
+    return functions;
+}
+
+constinit std::array<FunctionDefinition, max_functions> functions = initial_functions();
+constinit std::array<std::string, max_functions> names{}; // storage of the names of registered functions
+constinit std::atomic<std::size_t> count{builtin_functions.size()};
+constinit std::mutex registration;
+
+// applies a scalar libm function to the first argument of every row
+template<double (*Function)(double)>
+void map_values(double* arguments, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        arguments[i] = Function(arguments[i]);
+    }
+}
+
+} // namespace
+
+void builtin::sqrt_batch(double* arguments, std::size_t, std::size_t count) {
+    simd_kernels().sqrt(arguments, count);
+}
+
+void builtin::exp_batch(double* arguments, std::size_t, std::size_t count) {
+    map_values<std::exp>(arguments, count);
+}
+
+void builtin::log_batch(double* arguments, std::size_t, std::size_t count) {
+    map_values<std::log>(arguments, count);
+}
+
+void builtin::sin_batch(double* arguments, std::size_t, std::size_t count) {
+    map_values<std::sin>(arguments, count);
+}
+
+void builtin::cos_batch(double* arguments, std::size_t, std::size_t count) {
+    map_values<std::cos>(arguments, count);
+}
+
+void builtin::abs_batch(double* arguments, std::size_t, std::size_t count) {
+    simd_kernels().abs(arguments, count);
+}
+
+void builtin::min_batch(double* arguments, std::size_t stride, std::size_t count) {
+    simd_kernels().min(arguments, arguments + stride, count);
+}
+
+void builtin::max_batch(double* arguments, std::size_t stride, std::size_t count) {
+    simd_kernels().max(arguments, arguments + stride, count);
+}
+
+void builtin::clamp_batch(double* arguments, std::size_t stride, std::size_t count) {
+    const SimdKernels& kernels = simd_kernels();
+    kernels.max(arguments, arguments + stride, count);
+    kernels.min(arguments, arguments + 2 * stride, count);
+}
+
+// every function by id, entries below count are never written again
+const FunctionDefinition* function_table() {
+    return functions.data();
+}
+
+std::size_t registered_function_count() {
+    return count.load(std::memory_order_acquire);
+}
+
+// looks up a registered function that is not built in
+std::optional<std::size_t> find_registered_function(std::string_view name) {
+    const std::size_t registered = registered_function_count();
+    for (std::size_t id = builtin_functions.size(); id < registered; ++id) {
+        if (functions[id].name == name) {
+            return id;
+        }
+    }
+    return std::nullopt;
+}
+
+// registers a pure native function, the entry is complete before the count publishing it is stored
+std::size_t register_function(std::string_view name, std::size_t arity, ScalarFunction scalar, BatchFunction batch) {
+    if (name.empty() || is_digit(name.front()) || !std::ranges::all_of(name, is_operand_char)) {
+        throw std::invalid_argument("Invalid function name: " + std::string(name));
+    }
+    if (arity == 0 || arity > max_function_arity || scalar == nullptr) {
+        throw std::invalid_argument("Invalid function arity or implementation: " + std::string(name));
+    }
+
+    const std::lock_guard lock(registration);
+    if (find_function(name)) {
+        throw std::invalid_argument("Function already defined: " + std::string(name));
+    }
+    const std::size_t id = count.load(std::memory_order_relaxed);
+    if (id == max_functions) {
+        throw std::invalid_argument("Too many functions registered");
+    }
+    names[id] = name;
+    functions[id] = {names[id], arity, scalar, batch};
+    count.store(id + 1, std::memory_order_release);
+    return id;
+}
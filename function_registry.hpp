@@ -0,0 +1,146 @@
+#ifndef FUNCTION_REGISTRY_HPP
+#define FUNCTION_REGISTRY_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+// arguments a function call can take
+inline constexpr std::size_t max_function_arity = 4;
+
+// built-in and registered functions together, ids fit the one byte operands of the register bytecode
+inline constexpr std::size_t max_functions = 256;
+
+// computes a function of arity arguments
+using ScalarFunction = double (*)(const double* arguments);
+
+// computes a function for count rows, argument k of row i is arguments[k * stride + i], results replace the first argument
+using BatchFunction = void (*)(double* arguments, std::size_t stride, std::size_t count);
+
+// function callable from expressions as name(argument; argument; ...), ';' separates arguments because ','
+// is a decimal point, functions must be pure, the optimizer folds calls with constant arguments and shares
+// repeated calls
+struct FunctionDefinition {
+    std::string_view name;
+    std::size_t arity = 0;
+    ScalarFunction scalar = nullptr;
+    BatchFunction batch = nullptr; // nullptr calls scalar once per row
+};
+
+// the smaller of two values, the second one if they are unordered, like the minpd instruction
+constexpr double min_value(double a, double b) {
+    return a < b ? a : b;
+}
+
+// the larger of two values, the second one if they are unordered, like the maxpd instruction
+constexpr double max_value(double a, double b) {
+    return a > b ? a : b;
+}
+
+namespace builtin {
+
+constexpr double sqrt(const double* arguments) { return std::sqrt(arguments[0]); }
+constexpr double exp(const double* arguments) { return std::exp(arguments[0]); }
+constexpr double log(const double* arguments) { return std::log(arguments[0]); }
+constexpr double sin(const double* arguments) { return std::sin(arguments[0]); }
+constexpr double cos(const double* arguments) { return std::cos(arguments[0]); }
+constexpr double abs(const double* arguments) { return std::fabs(arguments[0]); }
+constexpr double min(const double* arguments) { return min_value(arguments[0], arguments[1]); }
+constexpr double max(const double* arguments) { return max_value(arguments[0], arguments[1]); }
+// clamp(x; low; high) as min(max(x; low); high), defined even if low > high
+constexpr double clamp(const double* arguments) { return min_value(max_value(arguments[0], arguments[1]), arguments[2]); }
+
+// block versions running on the vector kernels of the CPU where the instruction set has the operation
+void sqrt_batch(double* arguments, std::size_t stride, std::size_t count);
+void exp_batch(double* arguments, std::size_t stride, std::size_t count);
+void log_batch(double* arguments, std::size_t stride, std::size_t count);
+void sin_batch(double* arguments, std::size_t stride, std::size_t count);
+void cos_batch(double* arguments, std::size_t stride, std::size_t count);
+void abs_batch(double* arguments, std::size_t stride, std::size_t count);
+void min_batch(double* arguments, std::size_t stride, std::size_t count);
+void max_batch(double* arguments, std::size_t stride, std::size_t count);
+void clamp_batch(double* arguments, std::size_t stride, std::size_t count);
+
+} // namespace builtin
+
+// functions every expression can call, their ids are their positions and never change
+constexpr std::array<FunctionDefinition, 9> builtin_functions {{
+        {"sqrt", 1, builtin::sqrt, builtin::sqrt_batch},
+        {"exp", 1, builtin::exp, builtin::exp_batch},
+        {"log", 1, builtin::log, builtin::log_batch},
+        {"sin", 1, builtin::sin, builtin::sin_batch},
+        {"cos", 1, builtin::cos, builtin::cos_batch},
+        {"abs", 1, builtin::abs, builtin::abs_batch},
+        {"min", 2, builtin::min, builtin::min_batch},
+        {"max", 2, builtin::max, builtin::max_batch},
+        {"clamp", 3, builtin::clamp, builtin::clamp_batch},
+}};
+
+// every function by id, built-ins first, entries are written once before their id is published
+const FunctionDefinition* function_table();
+
+// number of built-in and registered functions
+std::size_t registered_function_count();
+
+// looks up a registered function that is not built in
+std::optional<std::size_t> find_registered_function(std::string_view name);
+
+// returns the number of functions, only the built-ins during constant evaluation
+constexpr std::size_t function_count() {
+    if consteval {
+        return builtin_functions.size();
+    }
+    return registered_function_count();
+}
+
+// returns the definition of a function id below function_count()
+constexpr const FunctionDefinition& function_definition(std::size_t id) {
+    if consteval {
+        return builtin_functions[id];
+    }
+    return function_table()[id];
+}
+
+// returns the id of a function, only built-ins are found during constant evaluation
+constexpr std::optional<std::size_t> find_function(std::string_view name) {
+    for (std::size_t id = 0; id < builtin_functions.size(); ++id) {
+        if (builtin_functions[id].name == name) {
+            return id;
+        }
+    }
+    if consteval {
+        return std::nullopt;
+    }
+    return find_registered_function(name);
+}
+
+// registers a pure native function and returns its id, throws std::invalid_argument if the name is taken or
+// not a variable name, the arity is not between 1 and max_function_arity or all max_functions ids are used,
+// registered functions stay until the process ends
+std::size_t register_function(std::string_view name, std::size_t arity, ScalarFunction scalar, BatchFunction batch = nullptr);
+
+// adapts a function taking its arguments as doubles to a ScalarFunction, the call is bound at compile time
+template<auto Function, typename... Arguments>
+constexpr ScalarFunction scalar_adapter(double (*)(Arguments...)) {
+    return [](const double* arguments) {
+        return [arguments]<std::size_t... I>(std::index_sequence<I...>) {
+            return Function(arguments[I]...);
+        }(std::index_sequence_for<Arguments...>());
+    };
+}
+
+template<typename... Arguments>
+constexpr std::size_t arity_of(double (*)(Arguments...)) {
+    return sizeof...(Arguments);
+}
+
+// registers a function taking doubles, e.g. register_function<hypotenuse>("hypot") for double hypotenuse(double, double)
+template<auto Function>
+std::size_t register_function(std::string_view name) {
+    return register_function(name, arity_of(+Function), scalar_adapter<Function>(+Function));
+}
+
+#endif //FUNCTION_REGISTRY_HPP
@@ -0,0 +1,147 @@
+#include "fused_program.hpp"
+#include "expression_dag.hpp"
+#include "jit_compiler.hpp"
+
+FusedProgram::FusedProgram(std::vector<Instruction> program, std::vector<std::size_t> segment_ends, std::vector<std::string> variables)
+        : program_(std::move(program)), segment_ends_(std::move(segment_ends)), variables_(std::move(variables)) {
+    // operands of every segment start from an empty stack, temporaries live above all of them
+    std::size_t depth = 0;
+    std::size_t segment = 0;
+    for (std::size_t i = 0; i < program_.size(); ++i) {
+        if (i == segment_ends_[segment]) {
+            depth = 0;
+            ++segment;
+        }
+        switch (program_[i].type) {
+            case Instruction::Type::Operator:
+                --depth;
+                break;
+            case Instruction::Type::Call:
+                depth -= function_definition(program_[i].slot).arity - 1;
+                break;
+            case Instruction::Type::Store:
+                max_stack_depth_ = std::max(max_stack_depth_, program_[i].slot + 1);
+                break;
+            default:
+                max_stack_depth_ = std::max(max_stack_depth_, ++depth);
+                break;
+        }
+    }
+
+    // fused programs are built for large batches, so their native code is generated right away
+    if (!segment_ends_.empty()) {
+        native_code_ = FusedJitFunction::compile(*this);
+    }
+}
+
+// evaluates every expression, results[i] receives expression i
+void FusedProgram::eval(std::span<const double> bindings, std::span<double> results) const {
+    if (const auto result = try_eval(bindings, results); !result) {
+        throw EvaluationError(result.error());
+    }
+}
+
+// evaluates every expression without throwing, the segments run one after another on a shared stack
+std::expected<void, EvalError> FusedProgram::try_eval(std::span<const double> bindings, std::span<double> results) const {
+    if (bindings.size() < variables_.size() || results.size() < expression_count()) {
+        return std::unexpected(EvalError{EvalErrorCode::NotEnoughBindings});
+    }
+
+    thread_local std::vector<double> stack;
+    if (stack.size() < max_stack_depth_) {
+        stack.resize(max_stack_depth_);
+    }
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < segment_ends_.size(); ++i) {
+        const std::span<const Instruction> segment(program_.data() + begin, segment_ends_[i] - begin);
+        const auto result = run_program(segment, bindings, stack.data());
+        if (!result) {
+            return std::unexpected(result.error());
+        }
+        results[i] = *result;
+        begin = segment_ends_[i];
+    }
+    return {};
+}
+
+// compiles expressions into one fused program, throws EvaluationError for the first malformed expression
+FusedProgram compile_fused(std::span<const std::string_view> expressions) {
+    auto fused = try_compile_fused(expressions);
+    if (!fused) {
+        // failures are rare, so the failing expression is only looked up to describe the error
+        for (const std::string_view expression : expressions) {
+            if (const auto compiled = try_compile(expression); !compiled) {
+                throw EvaluationError(compiled.error(), expression);
+            }
+        }
+        throw EvaluationError(fused.error());
+    }
+    return std::move(*fused);
+}
+
+FusedProgram compile_fused(std::span<const std::string> expressions) {
+    const std::vector<std::string_view> views(expressions.begin(), expressions.end());
+    return compile_fused(views);
+}
+
+// compiles every expression on its own, merges their programs into one graph and emits a segment per expression
+std::expected<FusedProgram, EvalError> try_compile_fused(std::span<const std::string_view> expressions) {
+    std::vector<std::string> variables;
+    ExpressionDag dag;
+    std::vector<std::uint32_t> roots;
+    roots.reserve(expressions.size());
+
+    std::vector<std::uint32_t> operands;
+    std::vector<std::uint32_t> temporaries;
+    for (const std::string_view expression : expressions) {
+        // passing the variables so far keeps their slots and appends the new ones
+        auto compiled = try_compile(expression, variables, true);
+        if (!compiled) {
+            return std::unexpected(compiled.error());
+        }
+        variables = compiled->variables();
+
+        operands.clear();
+        temporaries.assign(compiled->max_stack_depth(), 0);
+        for (const Instruction& instruction : compiled->program()) {
+            switch (instruction.type) {
+                case Instruction::Type::Number:
+                    operands.push_back(dag.add_number(instruction.value));
+                    break;
+                case Instruction::Type::Variable:
+                    operands.push_back(dag.add_variable(instruction.slot));
+                    break;
+                case Instruction::Type::Operator: {
+                    const std::uint32_t rhs = operands.back();
+                    operands.pop_back();
+                    operands.back() = dag.add_operator(instruction.op, operands.back(), rhs);
+                    break;
+                }
+                case Instruction::Type::Call: {
+                    const std::size_t arity = function_definition(instruction.slot).arity;
+                    const std::uint32_t call = dag.add_call(instruction.slot, std::span(operands).last(arity));
+                    operands.resize(operands.size() - arity);
+                    operands.push_back(call);
+                    break;
+                }
+                case Instruction::Type::Store:
+                    temporaries[instruction.slot] = operands.back();
+                    break;
+                case Instruction::Type::Load:
+                    operands.push_back(temporaries[instruction.slot]);
+                    break;
+            }
+        }
+        roots.push_back(operands.back());
+        dag.add_root(operands.back());
+    }
+
+    std::vector<std::size_t> segment_ends;
+    std::vector<Instruction> program = dag.emit(roots, segment_ends);
+    return FusedProgram(std::move(program), std::move(segment_ends), std::move(variables));
+}
+
+std::expected<FusedProgram, EvalError> try_compile_fused(std::span<const std::string> expressions) {
+    const std::vector<std::string_view> views(expressions.begin(), expressions.end());
+    return try_compile_fused(views);
+}
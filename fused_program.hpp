@@ -0,0 +1,54 @@
+#ifndef FUSED_PROGRAM_HPP
+#define FUSED_PROGRAM_HPP
+
+#include "expression_evaluator.hpp"
+
+#include <memory>
+
+class FusedJitFunction;
+
+// several expressions over the same variables compiled into one postfix program, subexpressions shared
+// between them are computed once, so a batch evaluation makes a single pass over the input columns
+// and fills one output column per expression
+//
+// the program is a sequence of segments, one per expression, each leaving only its result on the stack,
+// temporaries stored by one segment may be loaded by the ones after it
+class FusedProgram {
+public:
+    // evaluates every expression with bindings[slot] as the value of each variable, results[i] receives expression i
+    void eval(std::span<const double> bindings, std::span<double> results) const;
+
+    // evaluates every expression without throwing
+    std::expected<void, EvalError> try_eval(std::span<const double> bindings, std::span<double> results) const;
+
+    const std::vector<Instruction>& program() const { return program_; }
+    const std::vector<std::size_t>& segment_ends() const { return segment_ends_; } // end of each expression's instructions
+    const std::vector<std::string>& variables() const { return variables_; }
+    std::size_t expression_count() const { return segment_ends_.size(); }
+    std::size_t max_stack_depth() const { return max_stack_depth_; }
+
+    // packed native code evaluating all expressions, nullptr if the build has no JIT or a segment is too deep
+    const FusedJitFunction* native_code() const { return native_code_.get(); }
+
+private:
+    FusedProgram(std::vector<Instruction> program, std::vector<std::size_t> segment_ends, std::vector<std::string> variables);
+
+    friend std::expected<FusedProgram, EvalError> try_compile_fused(std::span<const std::string_view> expressions);
+
+    std::vector<Instruction> program_;
+    std::vector<std::size_t> segment_ends_;
+    std::vector<std::string> variables_;
+    std::size_t max_stack_depth_ = 0;
+    std::shared_ptr<const FusedJitFunction> native_code_; // shared by copies
+};
+
+// compiles expressions into one fused program, variables get slots in the order they first appear in any of them,
+// throws EvaluationError for the first malformed expression
+FusedProgram compile_fused(std::span<const std::string_view> expressions);
+FusedProgram compile_fused(std::span<const std::string> expressions);
+
+// compiles expressions into one fused program without throwing
+std::expected<FusedProgram, EvalError> try_compile_fused(std::span<const std::string_view> expressions);
+std::expected<FusedProgram, EvalError> try_compile_fused(std::span<const std::string> expressions);
+
+#endif //FUSED_PROGRAM_HPP
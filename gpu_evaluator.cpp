@@ -0,0 +1,414 @@
+#include "gpu_evaluator.hpp"
+#include "batch_evaluator.hpp"
+
+#include <CL/cl.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+// OpenCL C spelling of each built-in function, min and max keep the operand order of min_value() and max_value()
+constexpr std::array<std::pair<std::string_view, std::string_view>, 9> opencl_functions {{
+        {"sqrt", "sqrt"},
+        {"exp", "exp"},
+        {"log", "log"},
+        {"sin", "sin"},
+        {"cos", "cos"},
+        {"abs", "fabs"},
+        {"min", "min_value"},
+        {"max", "max_value"},
+        {"clamp", "clamp_value"},
+}};
+static_assert([] {
+    for (std::size_t id = 0; id < builtin_functions.size(); ++id) {
+        if (opencl_functions[id].first != builtin_functions[id].name) {
+            return false;
+        }
+    }
+    return opencl_functions.size() == builtin_functions.size();
+}());
+
+// contraction is off so a * b + c rounds twice like on the CPU
+constexpr std::string_view kernel_prelude = R"(#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#pragma OPENCL FP_CONTRACT OFF
+
+double min_value(double a, double b) { return a < b ? a : b; }
+double max_value(double a, double b) { return a > b ? a : b; }
+double clamp_value(double x, double low, double high) { return min_value(max_value(x, low), high); }
+
+__kernel void evaluate(__global const double* input, __global double* output, uint rows, uint stride, __global int* failed) {
+    const uint row = get_global_id(0);
+    if (row >= rows) {
+        return;
+    }
+)";
+
+std::string stack_entry(std::size_t index) {
+    return "s" + std::to_string(index);
+}
+
+// the exact bits of a constant, printed digits could round and lose infinities and NaNs
+std::string constant_literal(double value) {
+    std::array<char, 16> digits{};
+    const auto result = std::to_chars(digits.data(), digits.data() + digits.size(), std::bit_cast<std::uint64_t>(value), 16);
+    return "as_double(0x" + std::string(digits.data(), result.ptr) + "UL)";
+}
+
+// FNV-1a over the fields of every instruction, equal programs hash alike
+std::uint64_t program_hash(std::span<const Instruction> program) {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    const auto combine = [&hash](std::uint64_t word) {
+        hash = (hash ^ word) * 0x100000001b3;
+    };
+    for (const Instruction& instruction : program) {
+        combine(static_cast<std::uint64_t>(instruction.type));
+        combine(std::bit_cast<std::uint64_t>(instruction.value));
+        combine(static_cast<std::uint64_t>(instruction.op));
+        combine(instruction.slot);
+    }
+    return hash;
+}
+
+bool same_program(std::span<const Instruction> a, std::span<const Instruction> b) {
+    return std::ranges::equal(a, b, [](const Instruction& x, const Instruction& y) {
+        return x.type == y.type && std::bit_cast<std::uint64_t>(x.value) == std::bit_cast<std::uint64_t>(y.value) &&
+               x.op == y.op && x.slot == y.slot;
+    });
+}
+
+void check(cl_int status, const char* call) {
+    if (status != CL_SUCCESS) {
+        throw std::runtime_error(std::string(call) + " failed with OpenCL error " + std::to_string(status));
+    }
+}
+
+// waits for every command of the queues when leaving a scope, asynchronous copies read and write the
+// caller's columns until they complete, also when an error is thrown between enqueues
+struct QueueDrain {
+    std::span<const cl_command_queue> queues;
+
+    ~QueueDrain() {
+        for (cl_command_queue queue : queues) {
+            clFinish(queue);
+        }
+    }
+};
+
+} // namespace
+
+// OpenCL C source of a kernel evaluating a program once per row, every stack entry and temporary becomes a
+// private variable, which the OpenCL compiler keeps in registers
+std::optional<std::string> generate_opencl_kernel(std::span<const Instruction> program) {
+    std::string body;
+    std::size_t top = 0;
+    std::size_t entries = 0;
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+                body += "    " + stack_entry(top++) + " = " + constant_literal(instruction.value) + ";\n";
+                break;
+            case Instruction::Type::Variable:
+                body += "    " + stack_entry(top++) + " = input[" + std::to_string(instruction.slot) + "ul * stride + row];\n";
+                break;
+            case Instruction::Type::Operator: {
+                --top;
+                const std::string lhs = stack_entry(top - 1);
+                const std::string rhs = stack_entry(top);
+                switch (instruction.op) {
+                    case Operator::Addition:
+                        body += "    " + lhs + " = " + lhs + " + " + rhs + ";\n";
+                        break;
+                    case Operator::Subtraction:
+                        body += "    " + lhs + " = " + lhs + " - " + rhs + ";\n";
+                        break;
+                    case Operator::Multiplication:
+                        body += "    " + lhs + " = " + lhs + " * " + rhs + ";\n";
+                        break;
+                    case Operator::Division:
+                        body += "    if (" + rhs + " == 0.0) {\n        failed[0] = 1;\n    }\n";
+                        body += "    " + lhs + " = " + lhs + " / " + rhs + ";\n";
+                        break;
+                    case Operator::Exponentiation:
+                        body += "    " + lhs + " = pow(" + lhs + ", " + rhs + ");\n";
+                        break;
+                }
+                break;
+            }
+            case Instruction::Type::Call: {
+                if (instruction.slot >= builtin_functions.size()) {
+                    return std::nullopt;
+                }
+                const std::size_t arity = builtin_functions[instruction.slot].arity;
+                top -= arity;
+                std::string call = std::string(opencl_functions[instruction.slot].second) + "(";
+                for (std::size_t k = 0; k < arity; ++k) {
+                    call += (k == 0 ? "" : ", ") + stack_entry(top + k);
+                }
+                body += "    " + stack_entry(top++) + " = " + call + ");\n";
+                break;
+            }
+            case Instruction::Type::Store:
+                entries = std::max(entries, instruction.slot + 1);
+                body += "    " + stack_entry(instruction.slot) + " = " + stack_entry(top - 1) + ";\n";
+                break;
+            case Instruction::Type::Load:
+                body += "    " + stack_entry(top++) + " = " + stack_entry(instruction.slot) + ";\n";
+                break;
+        }
+        entries = std::max(entries, top);
+    }
+
+    std::string source(kernel_prelude);
+    for (std::size_t i = 0; i < entries; ++i) {
+        source += "    double " + stack_entry(i) + ";\n";
+    }
+    source += body;
+    source += "    output[row] = s0;\n}\n";
+    return source;
+}
+
+struct GpuEvaluator::Device {
+    // device memory of one queue, grown to the widest program seen
+    struct Buffers {
+        cl_mem input = nullptr;
+        std::size_t input_columns = 0;
+        cl_mem output = nullptr;
+        cl_mem failed = nullptr;
+    };
+
+    // built kernel of a program, the program is kept to tell colliding hashes apart
+    struct Kernel {
+        std::vector<Instruction> program;
+        cl_program built = nullptr;
+        cl_kernel kernel = nullptr;
+    };
+
+    cl_device_id id = nullptr;
+    cl_context context = nullptr;
+    std::array<cl_command_queue, 2> queues{};
+    std::array<Buffers, 2> buffers{};
+    std::string name;
+
+    std::mutex mutex; // guards everything below and the use of the queues
+    std::unordered_multimap<std::uint64_t, Kernel> kernels;
+
+    ~Device() {
+        for (const auto& [hash, kernel] : kernels) {
+            clReleaseKernel(kernel.kernel);
+            clReleaseProgram(kernel.built);
+        }
+        for (const Buffers& set : buffers) {
+            for (cl_mem memory : {set.input, set.output, set.failed}) {
+                if (memory != nullptr) {
+                    clReleaseMemObject(memory);
+                }
+            }
+        }
+        for (cl_command_queue queue : queues) {
+            if (queue != nullptr) {
+                clReleaseCommandQueue(queue);
+            }
+        }
+        if (context != nullptr) {
+            clReleaseContext(context);
+        }
+    }
+
+    // returns the kernel of a program, building it on first use, nullptr if the device cannot run it
+    cl_kernel kernel(std::span<const Instruction> program) {
+        const std::uint64_t hash = program_hash(program);
+        const auto [first, last] = kernels.equal_range(hash);
+        for (auto it = first; it != last; ++it) {
+            if (same_program(it->second.program, program)) {
+                return it->second.kernel;
+            }
+        }
+
+        const std::optional<std::string> source = generate_opencl_kernel(program);
+        if (!source) {
+            return nullptr;
+        }
+        const char* text = source->c_str();
+        cl_int status = CL_SUCCESS;
+        Kernel built;
+        built.program.assign(program.begin(), program.end());
+        built.built = clCreateProgramWithSource(context, 1, &text, nullptr, &status);
+        check(status, "clCreateProgramWithSource");
+        if (const cl_int build = clBuildProgram(built.built, 1, &id, "", nullptr, nullptr); build != CL_SUCCESS) {
+            clReleaseProgram(built.built);
+            check(build, "clBuildProgram");
+        }
+        built.kernel = clCreateKernel(built.built, "evaluate", &status);
+        if (status != CL_SUCCESS) {
+            clReleaseProgram(built.built);
+            check(status, "clCreateKernel");
+        }
+        return kernels.emplace(hash, std::move(built))->second.kernel;
+    }
+
+    // makes both buffer sets hold chunk_rows rows of columns variables
+    void reserve(std::size_t columns) {
+        columns = std::max<std::size_t>(columns, 1);
+        cl_int status = CL_SUCCESS;
+        for (Buffers& set : buffers) {
+            if (set.input_columns < columns) {
+                if (set.input != nullptr) {
+                    clReleaseMemObject(set.input);
+                    set.input = nullptr;
+                    set.input_columns = 0;
+                }
+                set.input = clCreateBuffer(context, CL_MEM_READ_ONLY, columns * chunk_rows * sizeof(double), nullptr, &status);
+                check(status, "clCreateBuffer");
+                set.input_columns = columns;
+            }
+            if (set.output == nullptr) {
+                set.output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, chunk_rows * sizeof(double), nullptr, &status);
+                check(status, "clCreateBuffer");
+            }
+            if (set.failed == nullptr) {
+                set.failed = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int), nullptr, &status);
+                check(status, "clCreateBuffer");
+            }
+        }
+    }
+};
+
+GpuEvaluator::GpuEvaluator(std::unique_ptr<Device> device) : device_(std::move(device)) {
+}
+
+GpuEvaluator::~GpuEvaluator() = default;
+
+// opens the first GPU supporting double precision, returns nullptr if there is none or no OpenCL runtime
+std::unique_ptr<GpuEvaluator> GpuEvaluator::create() {
+    cl_uint platform_count = 0;
+    if (clGetPlatformIDs(0, nullptr, &platform_count) != CL_SUCCESS || platform_count == 0) {
+        return nullptr;
+    }
+    std::vector<cl_platform_id> platforms(platform_count);
+    clGetPlatformIDs(platform_count, platforms.data(), nullptr);
+
+    for (cl_platform_id platform : platforms) {
+        cl_uint device_count = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, nullptr, &device_count) != CL_SUCCESS || device_count == 0) {
+            continue;
+        }
+        std::vector<cl_device_id> ids(device_count);
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, device_count, ids.data(), nullptr);
+        for (cl_device_id id : ids) {
+            cl_device_fp_config double_support = 0;
+            clGetDeviceInfo(id, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(double_support), &double_support, nullptr);
+            if (double_support == 0) {
+                continue;
+            }
+
+            auto device = std::make_unique<Device>();
+            device->id = id;
+            cl_int status = CL_SUCCESS;
+            device->context = clCreateContext(nullptr, 1, &id, nullptr, nullptr, &status);
+            if (status != CL_SUCCESS) {
+                continue;
+            }
+            for (cl_command_queue& queue : device->queues) {
+                queue = clCreateCommandQueue(device->context, id, 0, &status);
+                if (status != CL_SUCCESS) {
+                    queue = nullptr;
+                    break;
+                }
+            }
+            if (status != CL_SUCCESS) {
+                continue;
+            }
+
+            std::size_t name_size = 0;
+            clGetDeviceInfo(id, CL_DEVICE_NAME, 0, nullptr, &name_size);
+            device->name.resize(name_size);
+            clGetDeviceInfo(id, CL_DEVICE_NAME, name_size, device->name.data(), nullptr);
+            if (!device->name.empty() && device->name.back() == '\0') {
+                device->name.pop_back();
+            }
+            return std::unique_ptr<GpuEvaluator>(new GpuEvaluator(std::move(device)));
+        }
+    }
+    return nullptr;
+}
+
+// evaluates chunk after chunk, chunk i uses queue and buffers i % 2, in order queues keep a buffer set from
+// being overwritten before its last chunk has been read back, while the other queue copies or computes
+void GpuEvaluator::evaluate_batch(const CompiledExpression& expression, std::span<const double* const> columns, std::span<double> output) {
+    if (columns.size() < expression.variables().size()) {
+        throw EvaluationError({EvalErrorCode::NotEnoughBindings});
+    }
+    if (output.size() < gpu_min_rows) {
+        ::evaluate_batch(expression, columns, output);
+        return;
+    }
+
+    const std::lock_guard lock(device_->mutex);
+    const cl_kernel kernel = device_->kernel(expression.program());
+    if (kernel == nullptr) {
+        ::evaluate_batch(expression, columns, output);
+        return;
+    }
+    record(Metric::Evaluations);
+    record(Metric::BatchRows, output.size());
+    const PhaseTimer timer(Metric::EvaluateNanoseconds);
+
+    const std::size_t variable_count = expression.variables().size();
+    device_->reserve(variable_count);
+    const QueueDrain drain{device_->queues};
+    static constexpr cl_int no_failure = 0;
+    for (std::size_t set = 0; set < device_->queues.size(); ++set) {
+        check(clEnqueueWriteBuffer(device_->queues[set], device_->buffers[set].failed, CL_FALSE, 0, sizeof(cl_int), &no_failure,
+                                   0, nullptr, nullptr), "clEnqueueWriteBuffer");
+    }
+
+    const cl_uint stride = static_cast<cl_uint>(chunk_rows);
+    std::size_t chunk = 0;
+    for (std::size_t first_row = 0; first_row < output.size(); first_row += chunk_rows, ++chunk) {
+        const std::size_t set = chunk % device_->queues.size();
+        const cl_command_queue queue = device_->queues[set];
+        const Device::Buffers& buffers = device_->buffers[set];
+        const std::size_t count = std::min(chunk_rows, output.size() - first_row);
+        const cl_uint rows = static_cast<cl_uint>(count);
+
+        for (std::size_t slot = 0; slot < variable_count; ++slot) {
+            check(clEnqueueWriteBuffer(queue, buffers.input, CL_FALSE, slot * chunk_rows * sizeof(double), count * sizeof(double),
+                                       columns[slot] + first_row, 0, nullptr, nullptr), "clEnqueueWriteBuffer");
+        }
+        // arguments are captured when the kernel is enqueued, so both queues can share one kernel object
+        check(clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffers.input), "clSetKernelArg");
+        check(clSetKernelArg(kernel, 1, sizeof(cl_mem), &buffers.output), "clSetKernelArg");
+        check(clSetKernelArg(kernel, 2, sizeof(cl_uint), &rows), "clSetKernelArg");
+        check(clSetKernelArg(kernel, 3, sizeof(cl_uint), &stride), "clSetKernelArg");
+        check(clSetKernelArg(kernel, 4, sizeof(cl_mem), &buffers.failed), "clSetKernelArg");
+        check(clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &count, nullptr, 0, nullptr, nullptr), "clEnqueueNDRangeKernel");
+        check(clEnqueueReadBuffer(queue, buffers.output, CL_FALSE, 0, count * sizeof(double), output.data() + first_row,
+                                  0, nullptr, nullptr), "clEnqueueReadBuffer");
+    }
+
+    bool failed = false;
+    for (std::size_t set = 0; set < device_->queues.size(); ++set) {
+        cl_int status = 0;
+        check(clEnqueueReadBuffer(device_->queues[set], device_->buffers[set].failed, CL_TRUE, 0, sizeof(cl_int), &status,
+                                  0, nullptr, nullptr), "clEnqueueReadBuffer");
+        failed = failed || status != 0;
+    }
+    if (failed) {
+        throw EvaluationError({EvalErrorCode::DivisionByZero});
+    }
+}
+
+const std::string& GpuEvaluator::device_name() const {
+    return device_->name;
+}
+
+// kernels built so far
+std::size_t GpuEvaluator::cached_kernels() const {
+    const std::lock_guard lock(device_->mutex);
+    return device_->kernels.size();
+}
@@ -0,0 +1,58 @@
+#ifndef GPU_EVALUATOR_HPP
+#define GPU_EVALUATOR_HPP
+
+#include "expression_evaluator.hpp"
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
+// rows below which GpuEvaluator stays on the CPU, copying smaller batches to the device costs more than it saves
+constexpr std::size_t gpu_min_rows = std::size_t(1) << 20;
+
+// OpenCL C source of a kernel evaluating a program once per row, std::nullopt if the program calls a registered
+// function, which only exists as native code
+//
+// the kernel is evaluate(input, output, rows, stride, failed) where variable slot of row i is
+// input[slot * stride + i] and failed[0] is set to 1 on a division by zero
+std::optional<std::string> generate_opencl_kernel(std::span<const Instruction> program);
+
+// evaluates large batches on an OpenCL GPU with double precision, built by the optional
+// expression_evaluator_opencl target so the core library needs no GPU runtime
+//
+// kernels are generated from the program, built once and cached by program hash. Columns are streamed in
+// chunks through two sets of device buffers on two queues, so copying one chunk overlaps computing the other.
+// Operators round like the CPU, OpenCL pow, exp, log, sin and cos may be a few ulp less accurate than std::.
+// Thread safe, batches from several threads take turns on the device.
+class GpuEvaluator {
+public:
+    // rows copied to the device at once
+    static constexpr std::size_t chunk_rows = std::size_t(1) << 18;
+
+    // opens the first GPU supporting double precision, returns nullptr if there is none or no OpenCL runtime
+    static std::unique_ptr<GpuEvaluator> create();
+
+    GpuEvaluator(const GpuEvaluator&) = delete;
+    GpuEvaluator& operator=(const GpuEvaluator&) = delete;
+    ~GpuEvaluator();
+
+    // evaluates a compiled expression once per row of the output column like evaluate_batch(), batches below
+    // gpu_min_rows and programs calling registered functions run on the CPU, throws EvaluationError on a
+    // division by zero and std::runtime_error if the device fails
+    void evaluate_batch(const CompiledExpression& expression, std::span<const double* const> columns, std::span<double> output);
+
+    const std::string& device_name() const;
+
+    // kernels built so far
+    std::size_t cached_kernels() const;
+
+private:
+    struct Device;
+
+    explicit GpuEvaluator(std::unique_ptr<Device> device);
+
+    std::unique_ptr<Device> device_;
+};
+
+#endif //GPU_EVALUATOR_HPP
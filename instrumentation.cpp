@@ -0,0 +1,182 @@
+#include "instrumentation.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+using MetricValues = std::array<std::atomic<std::uint64_t>, metric_count>;
+
+// metric names and fields in the order of Metric
+constexpr std::array<std::pair<const char*, std::uint64_t InstrumentationStatistics::*>, metric_count> metric_fields {{
+        {"parse_ns", &InstrumentationStatistics::parse_ns},
+        {"number_parse_ns", &InstrumentationStatistics::number_parse_ns},
+        {"lower_ns", &InstrumentationStatistics::lower_ns},
+        {"optimize_ns", &InstrumentationStatistics::optimize_ns},
+        {"evaluate_ns", &InstrumentationStatistics::evaluate_ns},
+        {"expressions", &InstrumentationStatistics::expressions},
+        {"tokens", &InstrumentationStatistics::tokens},
+        {"numbers", &InstrumentationStatistics::numbers},
+        {"evaluations", &InstrumentationStatistics::evaluations},
+        {"batch_rows", &InstrumentationStatistics::batch_rows},
+        {"max_stack_depth", &InstrumentationStatistics::max_stack_depth},
+        {"allocations", &InstrumentationStatistics::allocations},
+        {"cache_hits", &InstrumentationStatistics::cache_hits},
+        {"cache_misses", &InstrumentationStatistics::cache_misses},
+}};
+
+// folds value into a sum, or a maximum for MaxStackDepth
+void accumulate(std::uint64_t& total, Metric metric, std::uint64_t value) {
+    total = metric == Metric::MaxStackDepth ? std::max(total, value) : total + value;
+}
+
+// metrics of every running thread and of the threads that exited
+struct Registry {
+    std::mutex mutex;
+    std::vector<MetricValues*> threads;
+    std::array<std::uint64_t, metric_count> exited {};
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// allocations are counted globally, per thread metrics would allocate while registering
+std::atomic<std::uint64_t> allocations = 0;
+
+// metrics of one thread, only written by that thread so updates never contend
+struct ThreadMetrics {
+    MetricValues values {};
+
+    ThreadMetrics() {
+        Registry& shared = registry();
+        std::lock_guard lock(shared.mutex);
+        shared.threads.push_back(&values);
+    }
+
+    ~ThreadMetrics() {
+        Registry& shared = registry();
+        std::lock_guard lock(shared.mutex);
+        for (std::size_t i = 0; i < metric_count; ++i) {
+            accumulate(shared.exited[i], static_cast<Metric>(i), values[i].load(std::memory_order_relaxed));
+        }
+        std::erase(shared.threads, &values);
+    }
+};
+
+std::atomic<std::uint64_t>& thread_metric(Metric metric) {
+    thread_local ThreadMetrics metrics;
+    return metrics.values[static_cast<std::size_t>(metric)];
+}
+
+} // namespace
+
+// returns the metrics of all threads
+InstrumentationStatistics instrumentation_statistics() {
+    std::array<std::uint64_t, metric_count> totals;
+    {
+        Registry& shared = registry();
+        std::lock_guard lock(shared.mutex);
+        totals = shared.exited;
+        for (const MetricValues* values : shared.threads) {
+            for (std::size_t i = 0; i < metric_count; ++i) {
+                accumulate(totals[i], static_cast<Metric>(i), (*values)[i].load(std::memory_order_relaxed));
+            }
+        }
+    }
+    totals[static_cast<std::size_t>(Metric::Allocations)] += allocations.load(std::memory_order_relaxed);
+
+    InstrumentationStatistics statistics;
+    for (std::size_t i = 0; i < metric_count; ++i) {
+        statistics.*metric_fields[i].second = totals[i];
+    }
+    return statistics;
+}
+
+// sets all metrics back to zero
+void reset_instrumentation() {
+    Registry& shared = registry();
+    std::lock_guard lock(shared.mutex);
+    shared.exited = {};
+    for (MetricValues* values : shared.threads) {
+        for (auto& value : *values) {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+    allocations.store(0, std::memory_order_relaxed);
+}
+
+// formats statistics as a JSON object
+std::string instrumentation_json(const InstrumentationStatistics& statistics) {
+    std::string json = instrumentation_enabled ? "{\"enabled\":true" : "{\"enabled\":false";
+    for (const auto& [name, field] : metric_fields) {
+        json += ",\"";
+        json += name;
+        json += "\":";
+        json += std::to_string(statistics.*field);
+    }
+    json += "}";
+    return json;
+}
+
+// adds to a metric of the current thread
+void record_metric(Metric metric, std::uint64_t value) {
+    thread_metric(metric).fetch_add(value, std::memory_order_relaxed);
+}
+
+// raises a metric of the current thread to at least value
+void record_metric_max(Metric metric, std::uint64_t value) {
+    std::atomic<std::uint64_t>& current = thread_metric(metric);
+    if (current.load(std::memory_order_relaxed) < value) {
+        current.store(value, std::memory_order_relaxed);
+    }
+}
+
+// steady clock in nanoseconds
+std::uint64_t instrumentation_clock() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#ifdef EXPRESSION_EVALUATOR_INSTRUMENTATION
+// counting replacements of the global allocation functions, the other forms forward to these
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto align = static_cast<std::size_t>(alignment);
+    if (void* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+#endif
@@ -0,0 +1,117 @@
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+
+#include <cstdint>
+#include <string>
+
+// whether metrics are recorded, off unless built with -DEXPRESSION_EVALUATOR_INSTRUMENTATION=ON,
+// disabled builds compile every recording call away
+#ifdef EXPRESSION_EVALUATOR_INSTRUMENTATION
+constexpr bool instrumentation_enabled = true;
+#else
+constexpr bool instrumentation_enabled = false;
+#endif
+
+// what the instrumentation counts, phases in nanoseconds
+enum class Metric {
+    ParseNanoseconds, // tokenizing and shunting yard, including number parsing
+    NumberParseNanoseconds,
+    LowerNanoseconds, // postfix tokens to instructions
+    OptimizeNanoseconds, // constant folding and common subexpressions
+    EvaluateNanoseconds,
+    Expressions, // expressions parsed by evaluate or compile
+    Tokens,
+    Numbers,
+    Evaluations, // programs run, a batch counts once
+    BatchRows,
+    MaxStackDepth, // the largest, not a sum
+    Allocations, // calls of the global operator new
+    CacheHits,
+    CacheMisses,
+};
+
+constexpr std::size_t metric_count = static_cast<std::size_t>(Metric::CacheMisses) + 1;
+
+// metrics summed over all threads since the start or the last reset
+struct InstrumentationStatistics {
+    std::uint64_t parse_ns = 0;
+    std::uint64_t number_parse_ns = 0;
+    std::uint64_t lower_ns = 0;
+    std::uint64_t optimize_ns = 0;
+    std::uint64_t evaluate_ns = 0;
+    std::uint64_t expressions = 0;
+    std::uint64_t tokens = 0;
+    std::uint64_t numbers = 0;
+    std::uint64_t evaluations = 0;
+    std::uint64_t batch_rows = 0;
+    std::uint64_t max_stack_depth = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t cache_hits = 0;
+    std::uint64_t cache_misses = 0;
+};
+
+// returns the metrics of all threads, all zero when instrumentation is disabled
+InstrumentationStatistics instrumentation_statistics();
+
+// sets all metrics back to zero
+void reset_instrumentation();
+
+// formats statistics as a JSON object, one member per metric plus "enabled"
+std::string instrumentation_json(const InstrumentationStatistics& statistics);
+
+// adds to a metric of the current thread, use record() which disappears from disabled builds
+void record_metric(Metric metric, std::uint64_t value);
+
+// raises a metric of the current thread to at least value
+void record_metric_max(Metric metric, std::uint64_t value);
+
+// steady clock in nanoseconds
+std::uint64_t instrumentation_clock();
+
+// current time for phase timing, 0 when instrumentation is disabled or during constant evaluation
+constexpr std::uint64_t instrumentation_now() {
+    if constexpr (instrumentation_enabled) {
+        if !consteval {
+            return instrumentation_clock();
+        }
+    }
+    return 0;
+}
+
+// adds to a metric, does nothing when instrumentation is disabled or during constant evaluation
+constexpr void record(Metric metric, std::uint64_t value = 1) {
+    if constexpr (instrumentation_enabled) {
+        if !consteval {
+            record_metric(metric, value);
+        }
+    }
+}
+
+// raises a metric to at least value, does nothing when instrumentation is disabled or during constant evaluation
+constexpr void record_max(Metric metric, std::uint64_t value) {
+    if constexpr (instrumentation_enabled) {
+        if !consteval {
+            record_metric_max(metric, value);
+        }
+    }
+}
+
+// adds the time passed since start, taken with instrumentation_now(), to a phase
+constexpr void record_phase(Metric phase, std::uint64_t start) {
+    record(phase, instrumentation_now() - start);
+}
+
+// adds its lifetime to a phase, for runtime code with several exits
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Metric phase) : phase_(phase), start_(instrumentation_now()) {}
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+    ~PhaseTimer() { record_phase(phase_, start_); }
+
+private:
+    Metric phase_;
+    std::uint64_t start_;
+};
+
+#endif //INSTRUMENTATION_HPP
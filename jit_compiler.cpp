@@ -0,0 +1,514 @@
+#include "jit_compiler.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#ifdef EXPRESSION_EVALUATOR_HAVE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef EXPRESSION_EVALUATOR_HAVE_JIT
+namespace {
+
+// general purpose register numbers as encoded in instructions
+enum Register {
+    rax = 0, rcx = 1, rdx = 2, rbx = 3, rsp = 4, rbp = 5, rsi = 6, rdi = 7,
+    r8 = 8, r9 = 9, r10 = 10, r11 = 11, r12 = 12, r13 = 13, r14 = 14, r15 = 15,
+};
+
+// no index register in a memory operand
+constexpr int no_index = -1;
+
+// SSE register holding the constant zero divisors are compared against
+constexpr int zero_register = 15;
+
+// SSE register for temporary values
+constexpr int scratch_register = 14;
+
+// temporaries a program may keep in the native stack frame
+constexpr std::size_t max_frame_slots = 4096;
+
+// smallest page size of x86-64, the distance between the stack probes of large frames
+constexpr std::int32_t page_size = 4096;
+
+// checks whether the operands of a program fit the SSE registers and its temporaries the native frame,
+// operands of every segment start from an empty stack, programs calling functions are left to the
+// interpreters since every call would have to spill the operands held in caller saved registers
+bool fits_native_frame(std::span<const Instruction> program, std::size_t stack_depth, std::span<const std::size_t> segment_ends = {}) {
+    std::size_t depth = 0;
+    std::size_t max_depth = 0;
+    std::size_t segment = 0;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (segment < segment_ends.size() && i == segment_ends[segment]) {
+            depth = 0;
+            ++segment;
+        }
+        if (program[i].type == Instruction::Type::Call) {
+            return false;
+        }
+        if (program[i].type == Instruction::Type::Operator) {
+            --depth;
+        } else if (program[i].type != Instruction::Type::Store) {
+            max_depth = std::max(max_depth, ++depth);
+        }
+    }
+    return max_depth <= JitFunction::max_stack_depth && stack_depth <= max_frame_slots;
+}
+
+// minimal encoder for the x86-64 instructions the code generator needs
+class Assembler {
+public:
+    std::vector<std::uint8_t> code;
+
+    void byte(std::uint8_t value) {
+        code.push_back(value);
+    }
+
+    void imm32(std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            byte(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void imm64(std::uint64_t value) {
+        imm32(static_cast<std::uint32_t>(value));
+        imm32(static_cast<std::uint32_t>(value >> 32));
+    }
+
+    // instruction with register operands, opcodes above 0xff are escaped with 0x0f
+    void op_rr(std::uint8_t prefix, bool wide, std::uint16_t opcode, int reg, int rm) {
+        begin(prefix, wide, opcode, reg, 0, rm);
+        byte(static_cast<std::uint8_t>(0xc0 | (reg & 7) << 3 | (rm & 7)));
+    }
+
+    // instruction with a [base + index * 8 + displacement] memory operand
+    void op_rm(std::uint8_t prefix, bool wide, std::uint16_t opcode, int reg, int base, int index, std::int32_t displacement) {
+        begin(prefix, wide, opcode, reg, index == no_index ? 0 : index, base);
+        if (index == no_index && (base & 7) != rsp) {
+            byte(static_cast<std::uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+        } else {
+            byte(static_cast<std::uint8_t>(0x80 | (reg & 7) << 3 | rsp));
+            byte(static_cast<std::uint8_t>((index == no_index ? 0x20 : 0xc0 | (index & 7) << 3) | (base & 7)));
+        }
+        imm32(static_cast<std::uint32_t>(displacement));
+    }
+
+    void push(int reg) {
+        if (reg >= 8)
+            byte(0x41);
+        byte(static_cast<std::uint8_t>(0x50 + (reg & 7)));
+    }
+
+    void pop(int reg) {
+        if (reg >= 8)
+            byte(0x41);
+        byte(static_cast<std::uint8_t>(0x58 + (reg & 7)));
+    }
+
+    void mov_imm64(int reg, std::uint64_t value) {
+        rex(true, 0, 0, reg);
+        byte(static_cast<std::uint8_t>(0xb8 + (reg & 7)));
+        imm64(value);
+    }
+
+    // emits a 32 bit relative jump or call and returns the position of its displacement
+    std::size_t jump(std::initializer_list<std::uint8_t> opcode) {
+        code.insert(code.end(), opcode);
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    // points the displacement at position to target
+    void patch(std::size_t position, std::size_t target) {
+        const auto displacement = static_cast<std::uint32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(position + 4));
+        std::memcpy(&code[position], &displacement, sizeof(displacement));
+    }
+
+private:
+    void rex(bool wide, int reg, int index, int base) {
+        const int prefix = 0x40 | wide << 3 | (reg >> 3 & 1) << 2 | (index >> 3 & 1) << 1 | (base >> 3 & 1);
+        if (prefix != 0x40)
+            byte(static_cast<std::uint8_t>(prefix));
+    }
+
+    void begin(std::uint8_t prefix, bool wide, std::uint16_t opcode, int reg, int index, int base) {
+        if (prefix != 0)
+            byte(prefix);
+        rex(wide, reg, index, base);
+        if (opcode > 0xff)
+            byte(0x0f);
+        byte(static_cast<std::uint8_t>(opcode));
+    }
+};
+
+// lowers a program to one function, either evaluating a single row with scalar instructions
+// or looping over rows two at a time with packed ones, stack entry i lives in xmm<i>
+class CodeGenerator {
+public:
+    // the frame has 16 bytes for every operand spilled around pow() calls or temporary, plus 8 so
+    // the stack stays 16 byte aligned after pushing four registers
+    CodeGenerator(bool packed, std::size_t frame_slots)
+            : packed_(packed), frame_size_(16 * static_cast<std::int32_t>(std::max(frame_slots, JitFunction::max_stack_depth)) + 8) {
+    }
+
+    // generates the function, packed code for a fused program writes the result of segment i to outputs[i]
+    // instead of writing its single result to output
+    std::vector<std::uint8_t> generate(std::span<const Instruction> program, std::span<const std::size_t> segment_ends = {}) {
+        emit_prologue();
+
+        std::size_t loop_start = 0;
+        std::size_t loop_exit = 0;
+        if (packed_) {
+            loop_start = as_.code.size();
+            as_.op_rr(0, true, 0x39, r13, r14); // cmp r14, r13
+            loop_exit = as_.jump({0x0f, 0x83}); // jae
+        }
+
+        std::size_t top = 0;
+        std::size_t segment = 0;
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            const Instruction& instruction = program[i];
+            switch (instruction.type) {
+                case Instruction::Type::Number:
+                    as_.mov_imm64(rax, std::bit_cast<std::uint64_t>(instruction.value));
+                    as_.op_rr(0x66, true, 0x0f6e, static_cast<int>(top), rax); // movq xmm, rax
+                    if (packed_)
+                        as_.op_rr(0x66, false, 0x0f14, static_cast<int>(top), static_cast<int>(top)); // unpcklpd
+                    ++top;
+                    break;
+                case Instruction::Type::Variable: {
+                    const auto offset = static_cast<std::int32_t>(8 * instruction.slot);
+                    if (packed_) {
+                        as_.op_rm(0, true, 0x8b, rax, rbx, no_index, offset); // mov rax, columns[slot]
+                        as_.op_rm(0x66, false, 0x0f10, static_cast<int>(top), rax, r14, 0); // movupd xmm, [rax + row * 8]
+                    } else {
+                        as_.op_rm(0xf2, false, 0x0f10, static_cast<int>(top), rbx, no_index, offset); // movsd xmm, bindings[slot]
+                    }
+                    ++top;
+                    break;
+                }
+                case Instruction::Type::Operator:
+                    --top;
+                    emit_operator(instruction.op, static_cast<int>(top - 1), static_cast<int>(top));
+                    break;
+                case Instruction::Type::Store: // movapd [rsp + 16 * slot], xmm
+                    as_.op_rm(0x66, false, 0x0f29, static_cast<int>(top - 1), rsp, no_index, 16 * static_cast<std::int32_t>(instruction.slot));
+                    break;
+                case Instruction::Type::Load: // movapd xmm, [rsp + 16 * slot]
+                    as_.op_rm(0x66, false, 0x0f28, static_cast<int>(top), rsp, no_index, 16 * static_cast<std::int32_t>(instruction.slot));
+                    ++top;
+                    break;
+                case Instruction::Type::Call: // rejected by fits_native_frame
+                    break;
+            }
+
+            if (segment < segment_ends.size() && i + 1 == segment_ends[segment]) {
+                as_.op_rm(0, true, 0x8b, rax, r12, no_index, 8 * static_cast<std::int32_t>(segment)); // mov rax, outputs[segment]
+                as_.op_rm(0x66, false, 0x0f11, 0, rax, r14, 0); // movupd [rax + row * 8], xmm0
+                top = 0;
+                ++segment;
+            }
+        }
+
+        if (packed_) {
+            if (segment_ends.empty())
+                as_.op_rm(0x66, false, 0x0f11, 0, r12, r14, 0); // movupd [output + row * 8], xmm0
+            as_.op_rr(0, true, 0x83, 0, r14); // add r14, 2
+            as_.byte(2);
+            as_.patch(as_.jump({0xe9}), loop_start);
+            as_.patch(loop_exit, as_.code.size());
+            as_.byte(0x31); // xor eax, eax
+            as_.byte(0xc0);
+        }
+        emit_epilogue();
+
+        // division by zero, reported through the status pointer or the return value
+        for (const std::size_t position : error_jumps_)
+            as_.patch(position, as_.code.size());
+        if (packed_) {
+            as_.byte(0xb8); // mov eax, 1
+            as_.imm32(1);
+        } else {
+            as_.op_rm(0, false, 0xc7, 0, r12, no_index, 0); // mov dword [status], 1
+            as_.imm32(1);
+        }
+        emit_epilogue();
+        return std::move(as_.code);
+    }
+
+private:
+    // saves the callee saved registers used for the arguments and reserves the spill area, frames larger
+    // than a page are reserved a page at a time and each page is touched, so the guard page of a thread
+    // stack faults instead of being jumped over
+    void emit_prologue() {
+        for (const int reg : {rbx, r12, r13, r14})
+            as_.push(reg);
+        std::int32_t reserved = 0;
+        for (; frame_size_ - reserved > page_size; reserved += page_size) {
+            as_.op_rr(0, true, 0x81, 5, rsp); // sub rsp, page_size
+            as_.imm32(static_cast<std::uint32_t>(page_size));
+            as_.op_rm(0, true, 0x83, 1, rsp, no_index, 0); // or qword [rsp], 0
+            as_.byte(0);
+        }
+        as_.op_rr(0, true, 0x81, 5, rsp); // sub rsp, the rest of frame_size
+        as_.imm32(static_cast<std::uint32_t>(frame_size_ - reserved));
+
+        as_.op_rr(0, true, 0x89, rdi, rbx); // mov rbx, rdi
+        as_.op_rr(0, true, 0x89, rsi, r12); // mov r12, rsi
+        if (packed_) {
+            as_.op_rr(0, true, 0x89, rdx, r13); // mov r13, rdx
+            as_.op_rr(0, true, 0x31, r14, r14); // xor r14, r14
+        }
+        emit_zero_register();
+    }
+
+    void emit_epilogue() {
+        as_.op_rr(0, true, 0x81, 0, rsp); // add rsp, frame_size
+        as_.imm32(static_cast<std::uint32_t>(frame_size_));
+        for (const int reg : {r14, r13, r12, rbx})
+            as_.pop(reg);
+        as_.byte(0xc3); // ret
+    }
+
+    void emit_zero_register() {
+        as_.op_rr(0x66, false, 0x0f57, zero_register, zero_register); // xorpd
+    }
+
+    // applies op on xmm<lhs> and xmm<rhs>, storing the result in xmm<lhs>
+    void emit_operator(Operator op, int lhs, int rhs) {
+        const std::uint8_t prefix = packed_ ? 0x66 : 0xf2;
+        switch (op) {
+            case Operator::Addition:
+                as_.op_rr(prefix, false, 0x0f58, lhs, rhs);
+                break;
+            case Operator::Subtraction:
+                as_.op_rr(prefix, false, 0x0f5c, lhs, rhs);
+                break;
+            case Operator::Multiplication:
+                as_.op_rr(prefix, false, 0x0f59, lhs, rhs);
+                break;
+            case Operator::Division:
+                emit_division_check(rhs);
+                as_.op_rr(prefix, false, 0x0f5e, lhs, rhs);
+                break;
+            case Operator::Exponentiation:
+                emit_pow(lhs, rhs);
+                break;
+        }
+    }
+
+    // jumps to the error exit if any lane of xmm<divisor> is zero, NaN divisors are let through
+    void emit_division_check(int divisor) {
+        if (packed_) {
+            as_.op_rr(0x66, false, 0x0f28, scratch_register, divisor); // movapd
+            as_.op_rr(0x66, false, 0x0fc2, scratch_register, zero_register); // cmpeqpd
+            as_.byte(0);
+            as_.op_rr(0x66, false, 0x0f50, rax, scratch_register); // movmskpd eax
+            as_.byte(0x85); // test eax, eax
+            as_.byte(0xc0);
+            error_jumps_.push_back(as_.jump({0x0f, 0x85})); // jnz
+        } else {
+            as_.op_rr(0x66, false, 0x0f2e, divisor, zero_register); // ucomisd
+            as_.byte(0x7a); // jp over the je, unordered means NaN
+            as_.byte(6);
+            error_jumps_.push_back(as_.jump({0x0f, 0x84})); // je
+        }
+    }
+
+    // calls std::pow once per lane, every SSE register is caller saved so live operands are spilled around the call
+    void emit_pow(int lhs, int rhs) {
+        for (int i = 0; i <= rhs; ++i)
+            as_.op_rm(0x66, false, 0x0f29, i, rsp, no_index, 16 * i); // movapd [rsp + 16 * i]
+
+        const auto pow = static_cast<double (*)(double, double)>(std::pow);
+        for (int lane = 0; lane < (packed_ ? 2 : 1); ++lane) {
+            as_.op_rm(0xf2, false, 0x0f10, 0, rsp, no_index, 16 * lhs + 8 * lane); // movsd xmm0
+            as_.op_rm(0xf2, false, 0x0f10, 1, rsp, no_index, 16 * rhs + 8 * lane); // movsd xmm1
+            as_.mov_imm64(rax, reinterpret_cast<std::uint64_t>(pow));
+            as_.byte(0xff); // call rax
+            as_.byte(0xd0);
+            as_.op_rm(0xf2, false, 0x0f11, 0, rsp, no_index, 16 * lhs + 8 * lane); // movsd [rsp + ...], xmm0
+        }
+
+        for (int i = 0; i <= lhs; ++i)
+            as_.op_rm(0x66, false, 0x0f28, i, rsp, no_index, 16 * i); // movapd xmm<i>, [rsp + 16 * i]
+        emit_zero_register();
+    }
+
+    bool packed_;
+    std::int32_t frame_size_;
+    Assembler as_;
+    std::vector<std::size_t> error_jumps_;
+};
+
+// copies code to a new mapping and makes it executable, returns nullptr if the system refuses
+void* map_executable(const std::vector<std::uint8_t>& code, std::size_t& size) {
+    const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    size = (code.size() + page_size - 1) / page_size * page_size;
+
+    // written first and made executable afterwards, never both at once
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    return memory;
+}
+
+} // namespace
+#endif
+
+// generates native code for an expression, returns nullptr if the build has no JIT or the program is too deep
+std::unique_ptr<JitFunction> JitFunction::compile(const CompiledExpression& expression) {
+#ifdef EXPRESSION_EVALUATOR_HAVE_JIT
+    if (!fits_native_frame(expression.program(), expression.max_stack_depth())) {
+        return nullptr;
+    }
+
+    // both functions share one mapping, the batch one starting 16 byte aligned
+    std::vector<std::uint8_t> code = CodeGenerator(false, expression.max_stack_depth()).generate(expression.program());
+    const std::size_t batch_offset = (code.size() + 15) & ~std::size_t(15);
+    const std::vector<std::uint8_t> batch = CodeGenerator(true, expression.max_stack_depth()).generate(expression.program());
+    code.resize(batch_offset);
+    code.insert(code.end(), batch.begin(), batch.end());
+
+    std::size_t size = 0;
+    void* memory = map_executable(code, size);
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    auto* bytes = static_cast<std::uint8_t*>(memory);
+
+    return std::unique_ptr<JitFunction>(new JitFunction(memory, size, reinterpret_cast<ScalarEntry>(bytes),
+                                                        reinterpret_cast<BatchEntry>(bytes + batch_offset),
+                                                        expression.variables().size()));
+#else
+    (void) expression;
+    return nullptr;
+#endif
+}
+
+JitFunction::JitFunction(void* memory, std::size_t size, ScalarEntry scalar, BatchEntry batch, std::size_t variable_count)
+        : memory_(memory), size_(size), scalar_(scalar), batch_(batch), variable_count_(variable_count) {
+}
+
+JitFunction::~JitFunction() {
+#ifdef EXPRESSION_EVALUATOR_HAVE_JIT
+    munmap(memory_, size_);
+#endif
+}
+
+// evaluates the native code with bindings[slot] as the value of each variable
+std::expected<double, EvalError> JitFunction::eval(std::span<const double> bindings) const {
+    int status = 0;
+    const double result = scalar_(bindings.data(), &status);
+    if (status != 0) {
+        return std::unexpected(EvalError{EvalErrorCode::DivisionByZero});
+    }
+    return result;
+}
+
+// evaluates the native code once per row of the output column, pairs of rows natively and an odd last row on its own
+std::expected<void, EvalError> JitFunction::eval_batch(std::span<const double* const> columns, std::span<double> output) const {
+    const std::size_t paired_rows = output.size() & ~std::size_t(1);
+    if (batch_(columns.data(), output.data(), paired_rows) != 0) {
+        return std::unexpected(EvalError{EvalErrorCode::DivisionByZero});
+    }
+    if (paired_rows == output.size()) {
+        return {};
+    }
+
+    thread_local std::vector<double> row;
+    row.resize(variable_count_);
+    for (std::size_t slot = 0; slot < variable_count_; ++slot) {
+        row[slot] = columns[slot][paired_rows];
+    }
+    const auto result = eval(row);
+    if (!result) {
+        return std::unexpected(result.error());
+    }
+    output[paired_rows] = *result;
+    return {};
+}
+
+// generates packed native code for a fused program, returns nullptr if the build has no JIT or a segment is too deep
+std::unique_ptr<FusedJitFunction> FusedJitFunction::compile(const FusedProgram& program) {
+#ifdef EXPRESSION_EVALUATOR_HAVE_JIT
+    if (!fits_native_frame(program.program(), program.max_stack_depth(), program.segment_ends())) {
+        return nullptr;
+    }
+
+    const std::vector<std::uint8_t> code = CodeGenerator(true, program.max_stack_depth()).generate(program.program(), program.segment_ends());
+    std::size_t size = 0;
+    void* memory = map_executable(code, size);
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    return std::unique_ptr<FusedJitFunction>(new FusedJitFunction(memory, size, reinterpret_cast<Entry>(memory)));
+#else
+    (void) program;
+    return nullptr;
+#endif
+}
+
+FusedJitFunction::FusedJitFunction(void* memory, std::size_t size, Entry entry) : memory_(memory), size_(size), entry_(entry) {
+}
+
+FusedJitFunction::~FusedJitFunction() {
+#ifdef EXPRESSION_EVALUATOR_HAVE_JIT
+    munmap(memory_, size_);
+#endif
+}
+
+// evaluates the native code once per row, pairs of rows natively and an odd last row through the program
+std::expected<void, EvalError> FusedJitFunction::eval_batch(const FusedProgram& program, std::span<const double* const> columns,
+                                                            std::span<double* const> outputs, std::size_t rows) const {
+    const std::size_t paired_rows = rows & ~std::size_t(1);
+    if (entry_(columns.data(), outputs.data(), paired_rows) != 0) {
+        return std::unexpected(EvalError{EvalErrorCode::DivisionByZero});
+    }
+    if (paired_rows == rows) {
+        return {};
+    }
+
+    thread_local std::vector<double> row;
+    thread_local std::vector<double> results;
+    row.resize(program.variables().size());
+    results.resize(program.expression_count());
+    for (std::size_t slot = 0; slot < row.size(); ++slot) {
+        row[slot] = columns[slot][paired_rows];
+    }
+    if (const auto result = program.try_eval(row, results); !result) {
+        return std::unexpected(result.error());
+    }
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        outputs[i][paired_rows] = results[i];
+    }
+    return {};
+}
+
+// records evaluations of the expression, returns its native code once it got hot and nullptr until then
+const JitFunction* JitTier::record(const CompiledExpression& expression, std::size_t evaluations) {
+    if (const JitFunction* function = function_.load(std::memory_order_acquire)) {
+        return function;
+    }
+    if (done_.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    // only the call crossing the threshold compiles, the others keep interpreting meanwhile
+    const std::size_t previous = evaluations_.fetch_add(evaluations, std::memory_order_relaxed);
+    if (previous >= threshold || previous + evaluations < threshold) {
+        return nullptr;
+    }
+    owned_ = JitFunction::compile(expression);
+    function_.store(owned_.get(), std::memory_order_release);
+    done_.store(true, std::memory_order_relaxed);
+    return owned_.get();
+}
@@ -0,0 +1,86 @@
+#ifndef JIT_COMPILER_HPP
+#define JIT_COMPILER_HPP
+
+#include "expression_evaluator.hpp"
+#include "fused_program.hpp"
+
+#include <atomic>
+#include <memory>
+
+// native x86-64 code generated for a compiled program, operands live in SSE2 registers
+class JitFunction {
+public:
+    // evaluates one row, status is set to non-zero on a division by zero
+    using ScalarEntry = double (*)(const double* bindings, int* status);
+
+    // evaluates an even number of rows two at a time, returns non-zero on a division by zero
+    using BatchEntry = int (*)(const double* const* columns, double* output, std::size_t count);
+
+    // operands that fit the SSE registers, deeper programs stay on the interpreter
+    static constexpr std::size_t max_stack_depth = 14;
+
+    // generates native code for an expression, returns nullptr if the build has no JIT or the program is too deep
+    static std::unique_ptr<JitFunction> compile(const CompiledExpression& expression);
+
+    JitFunction(const JitFunction&) = delete;
+    JitFunction& operator=(const JitFunction&) = delete;
+    ~JitFunction();
+
+    // evaluates the native code with bindings[slot] as the value of each variable, bindings are not checked
+    std::expected<double, EvalError> eval(std::span<const double> bindings) const;
+
+    // evaluates the native code once per row of the output column, columns are not checked
+    std::expected<void, EvalError> eval_batch(std::span<const double* const> columns, std::span<double> output) const;
+
+private:
+    JitFunction(void* memory, std::size_t size, ScalarEntry scalar, BatchEntry batch, std::size_t variable_count);
+
+    void* memory_;
+    std::size_t size_;
+    ScalarEntry scalar_;
+    BatchEntry batch_;
+    std::size_t variable_count_;
+};
+
+// packed native code of a fused program, evaluating every expression two rows at a time
+class FusedJitFunction {
+public:
+    // evaluates an even number of rows, writing the results of expression i to outputs[i], returns non-zero on a division by zero
+    using Entry = int (*)(const double* const* columns, double* const* outputs, std::size_t count);
+
+    // generates native code for a fused program, returns nullptr if the build has no JIT or a segment is too deep
+    static std::unique_ptr<FusedJitFunction> compile(const FusedProgram& program);
+
+    FusedJitFunction(const FusedJitFunction&) = delete;
+    FusedJitFunction& operator=(const FusedJitFunction&) = delete;
+    ~FusedJitFunction();
+
+    // evaluates the native code once per row, columns and outputs are not checked
+    std::expected<void, EvalError> eval_batch(const FusedProgram& program, std::span<const double* const> columns,
+                                              std::span<double* const> outputs, std::size_t rows) const;
+
+private:
+    FusedJitFunction(void* memory, std::size_t size, Entry entry);
+
+    void* memory_;
+    std::size_t size_;
+    Entry entry_;
+};
+
+// evaluation counter deciding when a compiled expression is hot enough to generate native code for it
+class JitTier {
+public:
+    // evaluations after which a program is compiled to native code
+    static constexpr std::size_t threshold = 1000;
+
+    // records evaluations of the expression, returns its native code once it got hot and nullptr until then
+    const JitFunction* record(const CompiledExpression& expression, std::size_t evaluations);
+
+private:
+    std::atomic<const JitFunction*> function_ = nullptr;
+    std::atomic<std::size_t> evaluations_ = 0;
+    std::atomic<bool> done_ = false; // compiled, or given up because the program is not supported
+    std::unique_ptr<JitFunction> owned_;
+};
+
+#endif //JIT_COMPILER_HPP
@@ -1,11 +1,99 @@
 #include "expression_evaluator.hpp"
-#include <format>
+#include "mapped_file.hpp"
+#include "stream_evaluator.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+// evaluates one expression per line of the file named by path, or of stdin for "-", on the given number of threads
+int run_stream(const char* path, std::size_t threads) {
+    // regular files are mapped and evaluated in place
+    if (std::strcmp(path, "-") != 0) {
+        if (auto mapped = MappedFile::map(path)) {
+            try {
+                StreamStatistics statistics;
+                if (threads > 1) {
+                    ThreadPool pool(threads);
+                    statistics = evaluate_text(mapped->text(), stdout, pool);
+                } else {
+                    statistics = evaluate_text(mapped->text(), stdout);
+                }
+                return statistics.errors > 0 ? 1 : 0;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+                return 2;
+            }
+        }
+    }
+
+    std::FILE* input = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "rb");
+    if (input == nullptr) {
+        std::cerr << "Cannot open " << path << ": " << std::strerror(errno) << '\n';
+        return 2;
+    }
+
+    int status = 0;
+    try {
+        StreamStatistics statistics;
+        if (threads > 1) {
+            ThreadPool pool(threads);
+            statistics = evaluate_stream(input, stdout, pool);
+        } else {
+            statistics = evaluate_stream(input, stdout);
+        }
+        status = statistics.errors > 0 ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        status = 2;
+    }
+    if (input != stdin) {
+        std::fclose(input);
+    }
+    return status;
+}
+
+// evaluates a stream or asks for a single expression
+int run(int argc, char* argv[]) {
+    // --stream [--threads N] [FILE]
+    if (argc > 1 && std::strcmp(argv[1], "--stream") == 0) {
+        std::size_t threads = ThreadPool::default_thread_count();
+        int next = 2;
+        if (argc > next + 1 && std::strcmp(argv[next], "--threads") == 0) {
+            const std::string_view count = argv[next + 1];
+            const auto result = std::from_chars(count.data(), count.data() + count.size(), threads);
+            if (result.ec != std::errc() || result.ptr != count.data() + count.size() || threads == 0) {
+                std::cerr << "Invalid thread count " << count << '\n';
+                return 2;
+            }
+            next += 2;
+        }
+        return run_stream(argc > next ? argv[next] : "-", threads);
+    }
 
-int main() {
     std::string expression;
 
     std::cout << "Enter an expression: ";
     std::getline(std::cin, expression);
 
-    std::cout << std::format("{}", evaluate(expression));
-}
\ No newline at end of file
+    std::array<char, 32> text;
+    const auto result = std::to_chars(text.data(), text.data() + text.size(), evaluate(expression));
+    std::cout << std::string_view(text.data(), result.ptr);
+    return 0;
+}
+
+// [--stats] followed by the arguments of run(), --stats prints the instrumentation metrics as JSON to stderr
+int main(int argc, char* argv[]) {
+    const bool statistics = argc > 1 && std::strcmp(argv[1], "--stats") == 0;
+    if (statistics) {
+        argv[1] = argv[0];
+        ++argv;
+        --argc;
+    }
+
+    const int status = run(argc, argv);
+    if (statistics) {
+        std::cerr << instrumentation_json(instrumentation_statistics()) << '\n';
+    }
+    return status;
+}
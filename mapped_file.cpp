@@ -0,0 +1,64 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef EXPRESSION_EVALUATOR_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// maps a regular file, returns std::nullopt if it cannot be opened or mapped
+std::optional<MappedFile> MappedFile::map(const char* path) {
+#ifdef EXPRESSION_EVALUATOR_HAVE_MMAP
+    const int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return std::nullopt;
+    }
+
+    struct stat status {};
+    if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+        close(descriptor);
+        return std::nullopt;
+    }
+    const auto size = static_cast<std::size_t>(status.st_size);
+    if (size == 0) {
+        // empty files cannot be mapped
+        close(descriptor);
+        return MappedFile(nullptr, 0);
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(descriptor);
+    if (memory == MAP_FAILED) {
+        return std::nullopt;
+    }
+    madvise(memory, size, MADV_SEQUENTIAL);
+    return MappedFile(static_cast<const char*>(memory), size);
+#else
+    (void) path;
+    return std::nullopt;
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+#ifdef EXPRESSION_EVALUATOR_HAVE_MMAP
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
@@ -0,0 +1,27 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <optional>
+#include <string_view>
+
+// read-only memory mapping of a whole file, its text is viewed in place instead of being copied into buffers
+class MappedFile {
+public:
+    // maps a regular file, returns std::nullopt if it cannot be opened or mapped, e.g. pipes, devices or
+    // platforms without mmap, callers fall back to reading it
+    static std::optional<MappedFile> map(const char* path);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    std::string_view text() const { return {data_, size_}; }
+
+private:
+    MappedFile(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+#endif //MAPPED_FILE_HPP
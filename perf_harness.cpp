@@ -0,0 +1,348 @@
+#include "corpus_generator.hpp"
+#include "expression_evaluator.hpp"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+// scale tests over generated corpora, complementing the microbenchmarks in bench.cpp
+//
+// perf_harness [options]                    measures every category and phase
+// perf_harness --corpus CATEGORY [options]  writes a corpus to stdout, one expression per line, e.g. for --stream
+//
+// options: --expressions N, --complexity N, --seed N, --repeats N, --threshold FRACTION,
+//          --baseline FILE to fail on regressions against one recorded with the same corpus options,
+//          --write-baseline FILE to record one
+
+namespace {
+
+std::atomic<std::size_t> live_bytes = 0;
+std::atomic<std::size_t> peak_bytes = 0;
+
+} // namespace
+
+// instrumented builds replace the allocation functions in the library already, they report no peak memory
+#ifndef EXPRESSION_EVALUATOR_INSTRUMENTATION
+constexpr bool tracks_memory = true;
+
+// tracking replacements of the global allocation functions, the size is kept in front of every block,
+// the other forms forward to these
+void* operator new(std::size_t size) {
+    constexpr std::size_t header = alignof(std::max_align_t);
+    auto* memory = static_cast<unsigned char*>(std::malloc(size + header));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    std::memcpy(memory, &size, sizeof(size));
+    const std::size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    std::size_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return memory + header;
+}
+
+void operator delete(void* memory) noexcept {
+    if (memory == nullptr) {
+        return;
+    }
+    auto* block = static_cast<unsigned char*>(memory) - alignof(std::max_align_t);
+    std::size_t size;
+    std::memcpy(&size, block, sizeof(size));
+    live_bytes.fetch_sub(size, std::memory_order_relaxed);
+    // block came from std::malloc in operator new, GCC only sees the pointer operator new returned
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+    std::free(block);
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    operator delete(memory);
+}
+#else
+constexpr bool tracks_memory = false;
+#endif
+
+namespace {
+
+// how a corpus is processed
+enum class Phase {
+    Evaluate, // try_evaluate, postfix conversion and the stack interpreter on per thread buffers
+    Compile, // try_compile with optimization, then one evaluation of the program
+    Pratt, // the Pratt parser front end alone
+};
+
+constexpr std::array<Phase, 3> phases{Phase::Evaluate, Phase::Compile, Phase::Pratt};
+
+const char* phase_name(Phase phase) {
+    switch (phase) {
+        case Phase::Evaluate:
+            return "evaluate";
+        case Phase::Compile:
+            return "compile";
+        case Phase::Pratt:
+            return "pratt";
+    }
+    return "unknown";
+}
+
+struct Measurement {
+    double megabytes_per_second = 0.0;
+    double expressions_per_second = 0.0;
+    std::size_t peak_bytes = 0; // heap growth at the highest point of a run
+    std::size_t errors = 0; // expressions rejected or failing, e.g. dividing by zero
+};
+
+// runs a phase over a corpus once, returns the number of errors
+std::size_t run_phase(Phase phase, const std::vector<std::string>& corpus) {
+    std::size_t errors = 0;
+    PostfixBuffers buffers;
+    for (const std::string& expression : corpus) {
+        switch (phase) {
+            case Phase::Evaluate:
+                errors += !try_evaluate(expression).has_value();
+                break;
+            case Phase::Compile: {
+                const auto compiled = try_compile(expression);
+                errors += !compiled || !compiled->try_eval().has_value();
+                break;
+            }
+            case Phase::Pratt:
+                errors += !pratt_to_postfix(expression, buffers).has_value();
+                break;
+        }
+    }
+    return errors;
+}
+
+// passes over the corpus are repeated until a run took this long, so short corpora are not timed by the clock's noise
+constexpr double min_run_seconds = 0.05;
+
+// best throughput of repeats runs, each on a fresh thread so per thread buffers grown by earlier runs do not hide
+// the memory a corpus needs
+Measurement measure(Phase phase, const std::vector<std::string>& corpus, std::size_t repeats) {
+    std::size_t bytes = 0;
+    for (const std::string& expression : corpus) {
+        bytes += expression.size();
+    }
+
+    Measurement measurement;
+    double best_seconds_per_pass = 0.0;
+    for (std::size_t repeat = 0; repeat < std::max<std::size_t>(repeats, 1); ++repeat) {
+        std::jthread([&] {
+            const std::size_t start_bytes = live_bytes.load();
+            peak_bytes.store(start_bytes);
+            const auto start = std::chrono::steady_clock::now();
+            std::size_t passes = 0;
+            std::chrono::duration<double> elapsed{};
+            do {
+                measurement.errors = run_phase(phase, corpus);
+                ++passes;
+                elapsed = std::chrono::steady_clock::now() - start;
+            } while (elapsed.count() < min_run_seconds);
+            measurement.peak_bytes = std::max(measurement.peak_bytes, peak_bytes.load() - start_bytes);
+            const double seconds_per_pass = elapsed.count() / static_cast<double>(passes);
+            if (repeat == 0 || seconds_per_pass < best_seconds_per_pass) {
+                best_seconds_per_pass = seconds_per_pass;
+            }
+        }).join();
+    }
+    best_seconds_per_pass = std::max(best_seconds_per_pass, 1e-9);
+    measurement.megabytes_per_second = static_cast<double>(bytes) / best_seconds_per_pass / 1e6;
+    measurement.expressions_per_second = static_cast<double>(corpus.size()) / best_seconds_per_pass;
+    return measurement;
+}
+
+// baseline entries by "category phase"
+using Baseline = std::map<std::string, Measurement, std::less<>>;
+
+// measurements of one corpus, only comparable with runs over the same corpus
+struct BaselineFile {
+    CorpusOptions options;
+    Baseline entries;
+};
+
+// reads an "options expressions complexity seed" line followed by lines of "category phase megabytes_per_second
+// peak_bytes", '#' starts a comment line
+std::optional<BaselineFile> read_baseline(const char* path) {
+    std::ifstream file(path);
+    if (!file) {
+        return std::nullopt;
+    }
+    BaselineFile baseline;
+    bool has_options = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string category;
+        if (!(fields >> category)) {
+            return std::nullopt;
+        }
+        if (category == "options") {
+            CorpusOptions& options = baseline.options;
+            if (has_options || !(fields >> options.expressions >> options.complexity >> options.seed)) {
+                return std::nullopt;
+            }
+            has_options = true;
+            continue;
+        }
+        std::string phase;
+        Measurement measurement;
+        if (!(fields >> phase >> measurement.megabytes_per_second >> measurement.peak_bytes)) {
+            return std::nullopt;
+        }
+        baseline.entries[category + " " + phase] = measurement;
+    }
+    if (!has_options) {
+        return std::nullopt;
+    }
+    return baseline;
+}
+
+bool write_baseline(const char* path, const Baseline& baseline, const CorpusOptions& options) {
+    std::ofstream file(path);
+    file << "# options expressions complexity seed\n";
+    file << "options " << options.expressions << ' ' << options.complexity << ' ' << options.seed << '\n';
+    file << "# category phase megabytes_per_second peak_bytes\n";
+    for (const auto& [key, measurement] : baseline) {
+        file << key << ' ' << measurement.megabytes_per_second << ' ' << measurement.peak_bytes << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+// parses a whole argument as a number
+template<typename Number>
+bool parse_argument(std::string_view text, Number& value) {
+    const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+} // namespace
+
+// measures every category and phase and compares them with a baseline, returns 1 if any regressed
+int main(int argc, char* argv[]) {
+    CorpusOptions options;
+    std::size_t repeats = 5;
+    double threshold = 0.2;
+    const char* baseline_path = nullptr;
+    const char* write_path = nullptr;
+    std::optional<CorpusCategory> corpus_only;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view option = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "Missing value of %s\n", argv[i]);
+            return 2;
+        }
+        const std::string_view value = argv[++i];
+        bool valid = true;
+        if (option == "--expressions") {
+            valid = parse_argument(value, options.expressions);
+        } else if (option == "--complexity") {
+            valid = parse_argument(value, options.complexity);
+        } else if (option == "--seed") {
+            valid = parse_argument(value, options.seed);
+        } else if (option == "--repeats") {
+            valid = parse_argument(value, repeats);
+        } else if (option == "--threshold") {
+            valid = parse_argument(value, threshold) && threshold >= 0.0;
+        } else if (option == "--baseline") {
+            baseline_path = argv[i];
+        } else if (option == "--write-baseline") {
+            write_path = argv[i];
+        } else if (option == "--corpus") {
+            corpus_only = find_corpus_category(value);
+            valid = corpus_only.has_value();
+        } else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i - 1]);
+            return 2;
+        }
+        if (!valid) {
+            std::fprintf(stderr, "Invalid value %s of %s\n", argv[i], argv[i - 1]);
+            return 2;
+        }
+    }
+
+    if (corpus_only) {
+        for (const std::string& expression : generate_corpus(*corpus_only, options)) {
+            std::fwrite(expression.data(), 1, expression.size(), stdout);
+            std::fputc('\n', stdout);
+        }
+        return 0;
+    }
+
+    std::optional<Baseline> baseline;
+    if (baseline_path != nullptr) {
+        const auto file = read_baseline(baseline_path);
+        if (!file) {
+            std::fprintf(stderr, "Cannot read baseline %s\n", baseline_path);
+            return 2;
+        }
+        // a baseline of another corpus would report or hide regressions that are not there
+        if (file->options.expressions != options.expressions || file->options.complexity != options.complexity ||
+            file->options.seed != options.seed) {
+            std::fprintf(stderr, "Baseline %s was measured with --expressions %zu --complexity %zu --seed %llu\n", baseline_path,
+                         file->options.expressions, file->options.complexity, static_cast<unsigned long long>(file->options.seed));
+            return 2;
+        }
+        baseline = file->entries;
+    }
+
+    std::printf("%-18s %-9s %10s %12s %12s %8s\n", "category", "phase", "MB/s", "expr/s", "peak KiB", "errors");
+    Baseline results;
+    std::size_t regressions = 0;
+    for (const CorpusCategory category : corpus_categories) {
+        const std::vector<std::string> corpus = generate_corpus(category, options);
+        for (const Phase phase : phases) {
+            const Measurement measurement = measure(phase, corpus, repeats);
+            const std::string key = std::string(corpus_category_name(category)) + " " + phase_name(phase);
+            results[key] = measurement;
+            std::printf("%-18s %-9s %10.2f %12.0f %12.1f %8zu", corpus_category_name(category), phase_name(phase),
+                        measurement.megabytes_per_second, measurement.expressions_per_second,
+                        tracks_memory ? static_cast<double>(measurement.peak_bytes) / 1024.0 : 0.0, measurement.errors);
+
+            if (baseline) {
+                const auto expected = baseline->find(key);
+                if (expected == baseline->end()) {
+                    std::printf("  not in baseline");
+                } else {
+                    // a page of slack so small peaks do not fail on allocator noise
+                    const bool slower = measurement.megabytes_per_second < expected->second.megabytes_per_second * (1.0 - threshold);
+                    const bool larger = tracks_memory && static_cast<double>(measurement.peak_bytes) >
+                                                         static_cast<double>(expected->second.peak_bytes) * (1.0 + threshold) + 4096.0;
+                    if (slower || larger) {
+                        std::printf("  REGRESSION%s%s", slower ? " throughput" : "", larger ? " memory" : "");
+                        ++regressions;
+                    }
+                }
+            }
+            std::printf("\n");
+        }
+    }
+
+    if (write_path != nullptr && !write_baseline(write_path, results, options)) {
+        std::fprintf(stderr, "Cannot write baseline %s\n", write_path);
+        return 2;
+    }
+    if (regressions > 0) {
+        std::printf("%zu regressions beyond %.0f%%\n", regressions, threshold * 100.0);
+        return 1;
+    }
+    return 0;
+}
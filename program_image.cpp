@@ -0,0 +1,272 @@
+#include "program_image.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace program_image;
+
+namespace {
+
+// FNV-1a over 8 byte words, cheap enough to check a whole image while it pages in
+std::uint64_t checksum(std::string_view bytes) {
+    std::uint64_t hash = 0xcbf29ce484222325;
+    std::size_t position = 0;
+    for (; position + sizeof(std::uint64_t) <= bytes.size(); position += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes.data() + position, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3;
+    }
+    for (; position < bytes.size(); ++position) {
+        hash = (hash ^ static_cast<unsigned char>(bytes[position])) * 0x100000001b3;
+    }
+    return hash;
+}
+
+// rounds an offset up to the alignment of T
+template <typename T>
+std::size_t align_for(std::size_t offset) {
+    return (offset + alignof(T) - 1) / alignof(T) * alignof(T);
+}
+
+// views count records of T at offset, which valid() checked to be in bounds and aligned
+template <typename T>
+std::span<const T> section(std::string_view bytes, std::uint64_t offset, std::uint64_t count) {
+    return {reinterpret_cast<const T*>(bytes.data() + offset), static_cast<std::size_t>(count)};
+}
+
+// checks that count records of T at offset lie inside the image and are aligned
+template <typename T>
+bool section_fits(std::string_view bytes, std::uint64_t offset, std::uint64_t count) {
+    return offset % alignof(T) == 0 && offset <= bytes.size() && count <= (bytes.size() - offset) / sizeof(T);
+}
+
+// checks what program_stack_depth() takes for granted, known instruction types and operators, calls of built-in
+// functions only, as the writer enforces, and temporaries inside the stack, so the check cannot allocate a huge frame
+bool valid_instructions(std::span<const Instruction> instructions, std::size_t max_stack_depth) {
+    for (const Instruction& instruction : instructions) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+            case Instruction::Type::Variable:
+                break;
+            case Instruction::Type::Operator:
+                if (static_cast<std::uint8_t>(instruction.op) > static_cast<std::uint8_t>(Operator::Exponentiation)) {
+                    return false;
+                }
+                break;
+            case Instruction::Type::Call:
+                if (instruction.slot >= builtin_functions.size()) {
+                    return false;
+                }
+                break;
+            case Instruction::Type::Store:
+            case Instruction::Type::Load:
+                if (instruction.slot >= max_stack_depth) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// evaluates the program with bindings[slot] as the value of each variable
+double StoredProgram::eval(std::span<const double> bindings) const {
+    const auto result = try_eval(bindings);
+    if (!result) {
+        throw EvaluationError(result.error());
+    }
+    return *result;
+}
+
+// evaluates the program in place on a per thread stack that only grows
+std::expected<double, EvalError> StoredProgram::try_eval(std::span<const double> bindings) const {
+    if (bindings.size() < variables_.size()) {
+        return std::unexpected(EvalError{EvalErrorCode::NotEnoughBindings});
+    }
+    record(Metric::Evaluations);
+
+    thread_local std::vector<double> stack;
+    if (stack.size() < max_stack_depth_) {
+        stack.resize(max_stack_depth_);
+    }
+    return run_program(program_, bindings, stack.data());
+}
+
+// copies the program into a compiled expression, which validates it again
+CompiledExpression StoredProgram::compile() const {
+    std::vector<std::string> variables;
+    variables.reserve(variables_.size());
+    for (std::size_t slot = 0; slot < variables_.size(); ++slot) {
+        variables.emplace_back(variable(slot));
+    }
+    return CompiledExpression(std::vector<Instruction>(program_.begin(), program_.end()), std::move(variables));
+}
+
+std::string_view StoredProgram::variable(std::size_t slot) const {
+    return {names_ + variables_[slot].name_offset, variables_[slot].name_length};
+}
+
+// maps an image file, returns std::nullopt if it cannot be mapped or is not a valid image
+std::optional<ProgramImage> ProgramImage::map(const char* path) {
+    std::optional<MappedFile> file = MappedFile::map(path);
+    if (!file || !valid(file->text())) {
+        return std::nullopt;
+    }
+    const std::string_view bytes = file->text();
+    return ProgramImage(std::move(file), bytes);
+}
+
+// views an image in memory, returns std::nullopt if it is not a valid image
+std::optional<ProgramImage> ProgramImage::view(std::string_view bytes) {
+    if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(Instruction) != 0 || !valid(bytes)) {
+        return std::nullopt;
+    }
+    return ProgramImage(std::nullopt, bytes);
+}
+
+// the mapping keeps its address when moved, so the views stay valid
+ProgramImage::ProgramImage(std::optional<MappedFile> file, std::string_view bytes) : file_(std::move(file)) {
+    Header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    programs_ = section<ProgramRecord>(bytes, header.programs_offset, header.program_count);
+    variables_ = section<VariableRecord>(bytes, header.variables_offset, header.variable_count);
+    instructions_ = section<Instruction>(bytes, header.instructions_offset, header.instruction_count);
+    names_ = bytes.data() + header.names_offset;
+}
+
+StoredProgram ProgramImage::operator[](std::size_t index) const {
+    const ProgramRecord& program = programs_[index];
+    return {instructions_.subspan(program.first_instruction, program.instruction_count), program.max_stack_depth,
+            variables_.subspan(program.first_variable, program.variable_count), names_};
+}
+
+// checks the header, the bounds of every section and record, and the checksum, and validates every program
+// like a freshly compiled one, since the checksum only detects accidental damage
+bool ProgramImage::valid(std::string_view bytes) {
+    Header header;
+    if (bytes.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.byte_order != byte_order ||
+        header.instruction_size != sizeof(Instruction) || header.instruction_alignment != alignof(Instruction)) {
+        return false;
+    }
+    if (!section_fits<ProgramRecord>(bytes, header.programs_offset, header.program_count) ||
+        !section_fits<VariableRecord>(bytes, header.variables_offset, header.variable_count) ||
+        !section_fits<Instruction>(bytes, header.instructions_offset, header.instruction_count) ||
+        !section_fits<char>(bytes, header.names_offset, header.name_bytes)) {
+        return false;
+    }
+    if (checksum(bytes.substr(sizeof(header))) != header.checksum) {
+        return false;
+    }
+
+    for (const ProgramRecord& program : section<ProgramRecord>(bytes, header.programs_offset, header.program_count)) {
+        if (program.first_instruction > header.instruction_count || program.instruction_count > header.instruction_count - program.first_instruction ||
+            program.first_variable > header.variable_count || program.variable_count > header.variable_count - program.first_variable ||
+            program.max_stack_depth == 0) {
+            return false;
+        }
+        const auto instructions = section<Instruction>(bytes, header.instructions_offset, header.instruction_count)
+                                          .subspan(program.first_instruction, program.instruction_count);
+        if (!valid_instructions(instructions, program.max_stack_depth)) {
+            return false;
+        }
+        const auto depth = program_stack_depth(instructions, program.variable_count);
+        // try_eval sizes its stack from the record, a larger depth than the program needs is rejected too
+        if (!depth || *depth != program.max_stack_depth) {
+            return false;
+        }
+    }
+    for (const VariableRecord& variable : section<VariableRecord>(bytes, header.variables_offset, header.variable_count)) {
+        if (variable.name_offset > header.name_bytes || variable.name_length > header.name_bytes - variable.name_offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// serializes compiled expressions, variables used by several programs are stored once per program
+// so every program keeps its own slot order
+std::string serialize_programs(std::span<const CompiledExpression> expressions) {
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byte_order = byte_order;
+    header.instruction_size = sizeof(Instruction);
+    header.instruction_alignment = alignof(Instruction);
+    header.program_count = expressions.size();
+    for (const CompiledExpression& expression : expressions) {
+        if (expression.program().size() > UINT32_MAX || expression.max_stack_depth() > UINT32_MAX) {
+            throw std::length_error("Program too large for a program image");
+        }
+        if (std::ranges::any_of(expression.program(), [](const Instruction& instruction) {
+                return instruction.type == Instruction::Type::Call && instruction.slot >= builtin_functions.size();
+            })) {
+            throw std::invalid_argument("Registered functions cannot be stored in a program image");
+        }
+        header.variable_count += expression.variables().size();
+        header.instruction_count += expression.program().size();
+        for (const std::string& variable : expression.variables()) {
+            header.name_bytes += variable.size();
+        }
+    }
+    if (header.variable_count > UINT32_MAX || header.name_bytes > UINT32_MAX) {
+        throw std::length_error("Too many variables for a program image");
+    }
+
+    header.programs_offset = align_for<ProgramRecord>(sizeof(Header));
+    header.variables_offset = align_for<VariableRecord>(header.programs_offset + header.program_count * sizeof(ProgramRecord));
+    header.instructions_offset = align_for<Instruction>(header.variables_offset + header.variable_count * sizeof(VariableRecord));
+    header.names_offset = header.instructions_offset + header.instruction_count * sizeof(Instruction);
+
+    std::string image(header.names_offset + header.name_bytes, '\0');
+    char* const bytes = image.data();
+    std::uint64_t first_instruction = 0;
+    std::uint32_t first_variable = 0;
+    std::uint32_t name_offset = 0;
+    for (std::size_t index = 0; index < expressions.size(); ++index) {
+        const CompiledExpression& expression = expressions[index];
+        const ProgramRecord program{first_instruction, static_cast<std::uint32_t>(expression.program().size()),
+                                    static_cast<std::uint32_t>(expression.max_stack_depth()), first_variable,
+                                    static_cast<std::uint32_t>(expression.variables().size())};
+        std::memcpy(bytes + header.programs_offset + index * sizeof(ProgramRecord), &program, sizeof(program));
+
+        // copied field by field so padding is written as zeros instead of whatever the source held
+        for (const Instruction& instruction : expression.program()) {
+            Instruction copy;
+            std::memset(static_cast<void*>(&copy), 0, sizeof(copy));
+            copy.type = instruction.type;
+            copy.value = instruction.value;
+            copy.op = instruction.op;
+            copy.slot = instruction.slot;
+            std::memcpy(bytes + header.instructions_offset + first_instruction++ * sizeof(Instruction), &copy, sizeof(copy));
+        }
+        for (const std::string& name : expression.variables()) {
+            const VariableRecord variable{name_offset, static_cast<std::uint32_t>(name.size())};
+            std::memcpy(bytes + header.variables_offset + first_variable++ * sizeof(VariableRecord), &variable, sizeof(variable));
+            std::memcpy(bytes + header.names_offset + name_offset, name.data(), name.size());
+            name_offset += static_cast<std::uint32_t>(name.size());
+        }
+    }
+
+    header.checksum = checksum(std::string_view(image).substr(sizeof(header)));
+    std::memcpy(bytes, &header, sizeof(header));
+    return image;
+}
+
+// writes compiled expressions to an image file, returns false if it cannot be written
+bool write_program_image(const char* path, std::span<const CompiledExpression> expressions) {
+    const std::string image = serialize_programs(expressions);
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+    return std::fclose(file) == 0 && written;
+}
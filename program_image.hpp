@@ -0,0 +1,119 @@
+#ifndef PROGRAM_IMAGE_HPP
+#define PROGRAM_IMAGE_HPP
+
+#include "expression_evaluator.hpp"
+#include "mapped_file.hpp"
+
+#include <optional>
+
+// binary image of compiled programs, written once and mapped at startup instead of compiling the expressions again
+//
+// the image holds a header, a record per program, a record per variable, the instructions and the variable names.
+// Records refer to each other by offsets from the start of the image, so it can be mapped anywhere. Instructions
+// are stored in their in-memory layout and evaluated in place, the header records that layout together with
+// the format version and byte order, and images written by an incompatible build are rejected. Calls refer to
+// functions by id, so only built-in functions can be stored.
+namespace program_image {
+
+inline constexpr char magic[8] = {'E', 'X', 'P', 'R', 'P', 'R', 'G', '\0'};
+inline constexpr std::uint32_t version = 2; // 2 added function calls
+inline constexpr std::uint32_t byte_order = 0x01020304;
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t instruction_size;
+    std::uint32_t instruction_alignment;
+    std::uint64_t program_count;
+    std::uint64_t programs_offset; // ProgramRecord[program_count]
+    std::uint64_t variable_count;
+    std::uint64_t variables_offset; // VariableRecord[variable_count]
+    std::uint64_t instruction_count;
+    std::uint64_t instructions_offset; // Instruction[instruction_count]
+    std::uint64_t name_bytes;
+    std::uint64_t names_offset; // variable names, not terminated
+    std::uint64_t checksum; // of everything after the header
+};
+
+struct ProgramRecord {
+    std::uint64_t first_instruction;
+    std::uint32_t instruction_count;
+    std::uint32_t max_stack_depth;
+    std::uint32_t first_variable;
+    std::uint32_t variable_count;
+};
+
+struct VariableRecord {
+    std::uint32_t name_offset;
+    std::uint32_t name_length;
+};
+
+static_assert(std::is_trivially_copyable_v<Instruction>);
+
+} // namespace program_image
+
+// program viewed in an image, evaluating it neither parses nor allocates
+class StoredProgram {
+public:
+    // evaluates the program with bindings[slot] as the value of each variable
+    double eval(std::span<const double> bindings = {}) const;
+
+    // evaluates the program without throwing
+    std::expected<double, EvalError> try_eval(std::span<const double> bindings = {}) const;
+
+    // copies the program into a compiled expression, e.g. to get native code for batches
+    CompiledExpression compile() const;
+
+    std::span<const Instruction> program() const { return program_; }
+    std::size_t max_stack_depth() const { return max_stack_depth_; }
+    std::size_t variable_count() const { return variables_.size(); }
+    std::string_view variable(std::size_t slot) const;
+
+private:
+    friend class ProgramImage;
+
+    StoredProgram(std::span<const Instruction> program, std::size_t max_stack_depth,
+                  std::span<const program_image::VariableRecord> variables, const char* names)
+            : program_(program), max_stack_depth_(max_stack_depth), variables_(variables), names_(names) {}
+
+    std::span<const Instruction> program_;
+    std::size_t max_stack_depth_;
+    std::span<const program_image::VariableRecord> variables_;
+    const char* names_;
+};
+
+// image of compiled programs, mapped from a file or viewed in memory the caller keeps alive
+class ProgramImage {
+public:
+    // maps an image file, returns std::nullopt if it cannot be mapped, was written by an incompatible build
+    // or is corrupted, callers then compile the expressions again
+    static std::optional<ProgramImage> map(const char* path);
+
+    // views an image in memory aligned like Instruction, returns std::nullopt if it is incompatible or corrupted
+    static std::optional<ProgramImage> view(std::string_view bytes);
+
+    std::size_t size() const { return programs_.size(); }
+    StoredProgram operator[](std::size_t index) const;
+
+private:
+    ProgramImage(std::optional<MappedFile> file, std::string_view bytes);
+
+    // checks the header, the bounds of every section and the checksum
+    static bool valid(std::string_view bytes);
+
+    std::optional<MappedFile> file_;
+    std::span<const program_image::ProgramRecord> programs_;
+    std::span<const program_image::VariableRecord> variables_;
+    std::span<const Instruction> instructions_;
+    const char* names_ = nullptr;
+};
+
+// serializes compiled expressions into an image, throws std::length_error if they exceed its 32 bit counts and
+// std::invalid_argument if they call registered functions, whose ids differ between processes
+std::string serialize_programs(std::span<const CompiledExpression> expressions);
+
+// writes compiled expressions to an image file, returns false if it cannot be written
+bool write_program_image(const char* path, std::span<const CompiledExpression> expressions);
+
+#endif //PROGRAM_IMAGE_HPP
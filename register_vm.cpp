@@ -0,0 +1,249 @@
+#include "register_vm.hpp"
+
+// labels as values give every handler its own indirect jump, which predicts better than one shared switch
+#if defined(__GNUC__) || defined(__clang__)
+#define REGISTER_VM_THREADED_DISPATCH
+#endif
+
+namespace {
+
+// value on the translation stack, results live in registers while constants and variables are not loaded
+// until an instruction cannot take them in place
+struct Operand {
+    enum class Kind {
+        Register,
+        Constant,
+        Variable,
+    };
+
+    Kind kind;
+    std::size_t index;
+};
+
+// opcode of an arithmetic operation for the kind of its right hand side
+Opcode arithmetic_opcode(Operator op, Operand::Kind rhs) {
+    const auto offset = static_cast<std::uint8_t>(op);
+    switch (rhs) {
+        case Operand::Kind::Register:
+            return static_cast<Opcode>(static_cast<std::uint8_t>(Opcode::Add) + offset);
+        case Operand::Kind::Constant:
+            return static_cast<Opcode>(static_cast<std::uint8_t>(Opcode::AddConstant) + offset);
+        case Operand::Kind::Variable:
+            return static_cast<Opcode>(static_cast<std::uint8_t>(Opcode::AddVariable) + offset);
+    }
+    throw std::runtime_error("Invalid operand kind");
+}
+
+static_assert(static_cast<int>(Opcode::Power) - static_cast<int>(Opcode::Add) == static_cast<int>(Operator::Exponentiation));
+static_assert(static_cast<int>(Opcode::PowerConstant) - static_cast<int>(Opcode::AddConstant) == static_cast<int>(Operator::Exponentiation));
+static_assert(static_cast<int>(Opcode::PowerVariable) - static_cast<int>(Opcode::AddVariable) == static_cast<int>(Operator::Exponentiation));
+
+} // namespace
+
+// translates a validated program, registers are numbered like the stack positions and temporaries of the program
+template<typename Value>
+std::unique_ptr<BasicRegisterProgram<Value>> BasicRegisterProgram<Value>::compile(std::span<const Instruction> program, std::size_t stack_depth) {
+    if (stack_depth > max_registers) {
+        return nullptr;
+    }
+
+    std::unique_ptr<BasicRegisterProgram> result(new BasicRegisterProgram());
+    result->register_count_ = stack_depth;
+    std::vector<Bytecode>& code = result->code_;
+    code.reserve(program.size() + 1);
+
+    // writes an operand to a register, indices of loads are split over both operand bytes
+    bool encodable = true;
+    const auto load = [&](const Operand& operand, std::size_t target) {
+        if (operand.kind == Operand::Kind::Register) {
+            code.push_back({Opcode::Move, static_cast<std::uint8_t>(target), static_cast<std::uint8_t>(operand.index)});
+            return;
+        }
+        encodable &= operand.index <= 0xFFFF;
+        code.push_back({operand.kind == Operand::Kind::Constant ? Opcode::LoadConstant : Opcode::LoadVariable,
+                        static_cast<std::uint8_t>(target), static_cast<std::uint8_t>(operand.index),
+                        static_cast<std::uint8_t>(operand.index >> 8)});
+    };
+    const auto in_place = [](const Operand& operand) {
+        return operand.kind == Operand::Kind::Register || operand.index <= 0xFF;
+    };
+
+    std::vector<Operand> stack;
+    stack.reserve(stack_depth);
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Number: {
+                const auto constant = NumericTraits<Value>::from_double(instruction.value);
+                if (!constant) {
+                    return nullptr;
+                }
+                stack.push_back({Operand::Kind::Constant, result->constants_.size()});
+                result->constants_.push_back(*constant);
+                break;
+            }
+            case Instruction::Type::Variable:
+                stack.push_back({Operand::Kind::Variable, instruction.slot});
+                break;
+            case Instruction::Type::Operator: {
+                Operand rhs = stack.back();
+                stack.pop_back();
+                Operand lhs = stack.back();
+                const std::size_t target = stack.size() - 1;
+
+                // a constant or variable on the left of a commutative operation is swapped to the right
+                const bool commutative = instruction.op == Operator::Addition || instruction.op == Operator::Multiplication;
+                if (lhs.kind != Operand::Kind::Register && rhs.kind == Operand::Kind::Register && commutative) {
+                    std::swap(lhs, rhs);
+                }
+                if (lhs.kind != Operand::Kind::Register) {
+                    load(lhs, target);
+                    lhs = {Operand::Kind::Register, target};
+                }
+                if (!in_place(rhs)) {
+                    load(rhs, target + 1);
+                    rhs = {Operand::Kind::Register, target + 1};
+                }
+                code.push_back({arithmetic_opcode(instruction.op, rhs.kind), static_cast<std::uint8_t>(target),
+                                static_cast<std::uint8_t>(lhs.index), static_cast<std::uint8_t>(rhs.index)});
+                stack.back() = {Operand::Kind::Register, target};
+                break;
+            }
+            case Instruction::Type::Call: {
+                // arguments are passed in consecutive registers starting at the first one
+                const std::size_t arity = function_definition(instruction.slot).arity;
+                const std::size_t target = stack.size() - arity;
+                for (std::size_t position = target; position < stack.size(); ++position) {
+                    if (stack[position].kind != Operand::Kind::Register || stack[position].index != position) {
+                        load(stack[position], position);
+                    }
+                }
+                code.push_back({Opcode::Call, static_cast<std::uint8_t>(target), static_cast<std::uint8_t>(instruction.slot)});
+                stack.resize(target + 1);
+                stack.back() = {Operand::Kind::Register, target};
+                break;
+            }
+            case Instruction::Type::Store: {
+                // loaded values still referring to the temporary are moved to their own register first
+                for (std::size_t position = 0; position < stack.size(); ++position) {
+                    if (stack[position].kind == Operand::Kind::Register && stack[position].index == instruction.slot) {
+                        load(stack[position], position);
+                        stack[position] = {Operand::Kind::Register, position};
+                    }
+                }
+                load(stack.back(), instruction.slot);
+                break;
+            }
+            case Instruction::Type::Load:
+                stack.push_back({Operand::Kind::Register, instruction.slot});
+                break;
+        }
+    }
+
+    if (stack.back().kind != Operand::Kind::Register) {
+        load(stack.back(), 0);
+        stack.back() = {Operand::Kind::Register, 0};
+    }
+    code.push_back({Opcode::Return, 0, static_cast<std::uint8_t>(stack.back().index)});
+
+    if (!encodable || result->register_count_ == 0) {
+        return nullptr;
+    }
+    return result;
+}
+
+// runs the bytecode with threaded dispatch where the compiler supports it and a switch otherwise
+template<typename Value>
+std::expected<Value, EvalError> BasicRegisterProgram<Value>::run(std::span<const Value> bindings, Value* registers) const {
+    using Arithmetic = NumericTraits<Value>;
+    const Bytecode* ip = code_.data();
+    const Value* constants = constants_.data();
+    const Value* variables = bindings.data();
+    Value* r = registers;
+
+#ifdef REGISTER_VM_THREADED_DISPATCH
+    // indexed by Opcode
+    static const void* const handlers[] = {
+            &&load_constant, &&load_variable, &&move,
+            &&add, &&subtract, &&multiply, &&divide, &&power,
+            &&add_constant, &&subtract_constant, &&multiply_constant, &&divide_constant, &&power_constant,
+            &&add_variable, &&subtract_variable, &&multiply_variable, &&divide_variable, &&power_variable,
+            &&call, &&return_result,
+    };
+#define VM_DISPATCH() goto *handlers[static_cast<std::size_t>(ip->opcode)]
+#define VM_CASE(label, opcode) label:
+#define VM_NEXT() ++ip; VM_DISPATCH()
+    VM_DISPATCH();
+#else
+#define VM_CASE(label, opcode) case Opcode::opcode:
+#define VM_NEXT() ++ip; continue
+    while (true) {
+    switch (ip->opcode) {
+#endif
+
+// the operator is a constant in every handler, so for double the checks of all but division fold away
+#define VM_ARITHMETIC(label, opcode, op, rhs) \
+    VM_CASE(label, opcode) { \
+        const auto result = Arithmetic::apply(Operator::op, r[ip->lhs], rhs); \
+        if (!result) { \
+            return std::unexpected(EvalError{result.error()}); \
+        } \
+        r[ip->dst] = *result; \
+    } \
+    VM_NEXT();
+
+    VM_CASE(load_constant, LoadConstant)
+        r[ip->dst] = constants[ip->lhs | ip->rhs << 8];
+        VM_NEXT();
+    VM_CASE(load_variable, LoadVariable)
+        r[ip->dst] = variables[ip->lhs | ip->rhs << 8];
+        VM_NEXT();
+    VM_CASE(move, Move)
+        r[ip->dst] = r[ip->lhs];
+        VM_NEXT();
+
+    VM_ARITHMETIC(add, Add, Addition, r[ip->rhs])
+    VM_ARITHMETIC(subtract, Subtract, Subtraction, r[ip->rhs])
+    VM_ARITHMETIC(multiply, Multiply, Multiplication, r[ip->rhs])
+    VM_ARITHMETIC(divide, Divide, Division, r[ip->rhs])
+    VM_ARITHMETIC(power, Power, Exponentiation, r[ip->rhs])
+
+    VM_ARITHMETIC(add_constant, AddConstant, Addition, constants[ip->rhs])
+    VM_ARITHMETIC(subtract_constant, SubtractConstant, Subtraction, constants[ip->rhs])
+    VM_ARITHMETIC(multiply_constant, MultiplyConstant, Multiplication, constants[ip->rhs])
+    VM_ARITHMETIC(divide_constant, DivideConstant, Division, constants[ip->rhs])
+    VM_ARITHMETIC(power_constant, PowerConstant, Exponentiation, constants[ip->rhs])
+
+    VM_ARITHMETIC(add_variable, AddVariable, Addition, variables[ip->rhs])
+    VM_ARITHMETIC(subtract_variable, SubtractVariable, Subtraction, variables[ip->rhs])
+    VM_ARITHMETIC(multiply_variable, MultiplyVariable, Multiplication, variables[ip->rhs])
+    VM_ARITHMETIC(divide_variable, DivideVariable, Division, variables[ip->rhs])
+    VM_ARITHMETIC(power_variable, PowerVariable, Exponentiation, variables[ip->rhs])
+
+    VM_CASE(call, Call) {
+        const auto result = call_function(function_table()[ip->lhs], r + ip->dst);
+        if (!result) {
+            return std::unexpected(EvalError{result.error()});
+        }
+        r[ip->dst] = *result;
+    }
+        VM_NEXT();
+
+    VM_CASE(return_result, Return)
+        return r[ip->lhs];
+
+#ifndef REGISTER_VM_THREADED_DISPATCH
+    }
+    }
+#endif
+
+#undef VM_ARITHMETIC
+#undef VM_NEXT
+#undef VM_CASE
+#undef VM_DISPATCH
+}
+
+template class BasicRegisterProgram<float>;
+template class BasicRegisterProgram<double>;
+#ifdef EXPRESSION_EVALUATOR_HAVE_FIXED_POINT
+template class BasicRegisterProgram<Fixed64>;
+#endif
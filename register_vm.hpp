@@ -0,0 +1,79 @@
+#ifndef REGISTER_VM_HPP
+#define REGISTER_VM_HPP
+
+#include "expression_evaluator.hpp"
+#include "fixed_point.hpp"
+
+#include <cstdint>
+#include <memory>
+
+// operation of a bytecode instruction, arithmetic takes its right hand side from a register,
+// the constant pool or the bindings
+enum class Opcode : std::uint8_t {
+    LoadConstant, // r[dst] = constants[lhs | rhs << 8]
+    LoadVariable, // r[dst] = bindings[lhs | rhs << 8]
+    Move, // r[dst] = r[lhs]
+    Add, // r[dst] = r[lhs] op r[rhs]
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    AddConstant, // r[dst] = r[lhs] op constants[rhs]
+    SubtractConstant,
+    MultiplyConstant,
+    DivideConstant,
+    PowerConstant,
+    AddVariable, // r[dst] = r[lhs] op bindings[rhs]
+    SubtractVariable,
+    MultiplyVariable,
+    DivideVariable,
+    PowerVariable,
+    Call, // r[dst] = function lhs applied to r[dst], r[dst + 1], ...
+    Return, // result is r[lhs]
+};
+
+// one 4 byte instruction, operands are register, constant or binding indices depending on the opcode
+struct Bytecode {
+    Opcode opcode;
+    std::uint8_t dst = 0;
+    std::uint8_t lhs = 0;
+    std::uint8_t rhs = 0;
+};
+
+static_assert(sizeof(Bytecode) == 4);
+
+// compiled program translated to register bytecode, operands stay in the register they were computed in
+// instead of being pushed and popped, constants and variables are read in place by the instruction using them,
+// registers, constants and bindings hold Value, instantiated for float, double and Fixed64
+template<typename Value>
+class BasicRegisterProgram {
+public:
+    // registers addressable by one byte
+    static constexpr std::size_t max_registers = 256;
+
+    // translates a validated program needing stack_depth operands, returns nullptr if it needs more registers,
+    // constants or variables than the encoding can address or a constant is not representable as Value
+    static std::unique_ptr<BasicRegisterProgram> compile(std::span<const Instruction> program, std::size_t stack_depth);
+
+    // runs the bytecode on registers with room for register_count() values, bindings are not checked
+    std::expected<Value, EvalError> run(std::span<const Value> bindings, Value* registers) const;
+
+    const std::vector<Bytecode>& code() const { return code_; }
+    const std::vector<Value>& constants() const { return constants_; }
+    std::size_t register_count() const { return register_count_; }
+
+private:
+    BasicRegisterProgram() = default;
+
+    std::vector<Bytecode> code_;
+    std::vector<Value> constants_;
+    std::size_t register_count_ = 0;
+};
+
+extern template class BasicRegisterProgram<float>;
+extern template class BasicRegisterProgram<double>;
+#ifdef EXPRESSION_EVALUATOR_HAVE_FIXED_POINT
+extern template class BasicRegisterProgram<Fixed64>;
+#endif
+
+#endif //REGISTER_VM_HPP
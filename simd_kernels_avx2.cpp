@@ -0,0 +1,74 @@
+// built with AVX2 and FMA enabled, only called after detect_simd_level() confirmed CPU support
+
+#include "simd_kernels_impl.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Ops {
+    using V = __m256d;
+    static constexpr std::size_t lanes = 4;
+
+    static V load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, V v) { _mm256_storeu_pd(p, v); }
+    static V set1(double value) { return _mm256_set1_pd(value); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm256_div_pd(a, b); }
+    static V fma(V a, V b, V c) { return _mm256_fmadd_pd(a, b, c); }
+    static V round(V a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+    static V abs(V a) { return _mm256_andnot_pd(set1(-0.0), a); }
+    static V min(V a, V b) { return _mm256_min_pd(a, b); }
+    static V max(V a, V b) { return _mm256_max_pd(a, b); }
+
+    static bool all_within(V v, double low, double high) {
+        const V inside = _mm256_and_pd(_mm256_cmp_pd(v, set1(low), _CMP_GE_OQ), _mm256_cmp_pd(v, set1(high), _CMP_LE_OQ));
+        return _mm256_movemask_pd(inside) == 0xf;
+    }
+
+    static bool any_equal(V v, double value) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(v, set1(value), _CMP_EQ_OQ)) != 0;
+    }
+
+    static void split(V x, V& exponent, V& mantissa) {
+        const __m256i bits = _mm256_castpd_si256(x);
+        const __m256i shifted = _mm256_add_epi64(_mm256_sub_epi64(bits, _mm256_set1_epi64x(mantissa_offset)),
+                                                 _mm256_set1_epi64x(exponent_bias_bits));
+        const __m256i biased = _mm256_or_si256(_mm256_srli_epi64(shifted, 52), _mm256_set1_epi64x(as_bits(0x1p52)));
+        exponent = sub(_mm256_castsi256_pd(biased), set1(integer_magic));
+        mantissa = _mm256_castsi256_pd(_mm256_add_epi64(
+                _mm256_sub_epi64(bits, _mm256_and_si256(shifted, _mm256_set1_epi64x(exponent_mask))),
+                _mm256_set1_epi64x(exponent_bias_bits)));
+    }
+
+    static V exp2_integer(V n) {
+        return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(add(n, set1(integer_magic))), 52));
+    }
+};
+
+struct Avx2FloatOps {
+    using V = __m256;
+    static constexpr std::size_t lanes = 8;
+
+    static V load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm256_div_ps(a, b); }
+
+    static bool any_equal(V v, float value) {
+        return _mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_set1_ps(value), _CMP_EQ_OQ)) != 0;
+    }
+};
+
+constexpr SimdKernels kernels = make_kernels<Avx2Ops, Avx2FloatOps>(SimdLevel::Avx2);
+
+} // namespace
+
+const SimdKernels& avx2_kernels() {
+    return kernels;
+}
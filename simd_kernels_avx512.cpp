@@ -0,0 +1,74 @@
+// built with AVX-512F enabled, only called after detect_simd_level() confirmed CPU support
+
+#include "simd_kernels_impl.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx512Ops {
+    using V = __m512d;
+    static constexpr std::size_t lanes = 8;
+
+    static V load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, V v) { _mm512_storeu_pd(p, v); }
+    static V set1(double value) { return _mm512_set1_pd(value); }
+    static V add(V a, V b) { return _mm512_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm512_div_pd(a, b); }
+    static V fma(V a, V b, V c) { return _mm512_fmadd_pd(a, b, c); }
+    static V round(V a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static V sqrt(V a) { return _mm512_sqrt_pd(a); }
+    static V abs(V a) { return _mm512_abs_pd(a); }
+    static V min(V a, V b) { return _mm512_min_pd(a, b); }
+    static V max(V a, V b) { return _mm512_max_pd(a, b); }
+
+    static bool all_within(V v, double low, double high) {
+        const __mmask8 inside = _mm512_cmp_pd_mask(v, set1(low), _CMP_GE_OQ) & _mm512_cmp_pd_mask(v, set1(high), _CMP_LE_OQ);
+        return inside == 0xff;
+    }
+
+    static bool any_equal(V v, double value) {
+        return _mm512_cmp_pd_mask(v, set1(value), _CMP_EQ_OQ) != 0;
+    }
+
+    static void split(V x, V& exponent, V& mantissa) {
+        const __m512i bits = _mm512_castpd_si512(x);
+        const __m512i shifted = _mm512_add_epi64(_mm512_sub_epi64(bits, _mm512_set1_epi64(mantissa_offset)),
+                                                 _mm512_set1_epi64(exponent_bias_bits));
+        const __m512i biased = _mm512_or_si512(_mm512_srli_epi64(shifted, 52), _mm512_set1_epi64(as_bits(0x1p52)));
+        exponent = sub(_mm512_castsi512_pd(biased), set1(integer_magic));
+        mantissa = _mm512_castsi512_pd(_mm512_add_epi64(
+                _mm512_sub_epi64(bits, _mm512_and_si512(shifted, _mm512_set1_epi64(exponent_mask))),
+                _mm512_set1_epi64(exponent_bias_bits)));
+    }
+
+    static V exp2_integer(V n) {
+        return _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_castpd_si512(add(n, set1(integer_magic))), 52));
+    }
+};
+
+struct Avx512FloatOps {
+    using V = __m512;
+    static constexpr std::size_t lanes = 16;
+
+    static V load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, V v) { _mm512_storeu_ps(p, v); }
+    static V add(V a, V b) { return _mm512_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm512_div_ps(a, b); }
+
+    static bool any_equal(V v, float value) {
+        return _mm512_cmp_ps_mask(v, _mm512_set1_ps(value), _CMP_EQ_OQ) != 0;
+    }
+};
+
+constexpr SimdKernels kernels = make_kernels<Avx512Ops, Avx512FloatOps>(SimdLevel::Avx512);
+
+} // namespace
+
+const SimdKernels& avx512_kernels() {
+    return kernels;
+}
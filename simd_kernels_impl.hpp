@@ -0,0 +1,321 @@
+#ifndef SIMD_KERNELS_IMPL_HPP
+#define SIMD_KERNELS_IMPL_HPP
+
+// kernel templates shared by the per instruction set translation units,
+// everything has internal linkage so code built with wider instruction sets never leaks into other units,
+// units including it must be built with -ffp-contract=off or the double-double arithmetic in pow breaks
+
+#include "simd_kernels.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+std::uint64_t as_bits(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double as_double(std::uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// bit patterns used to split a double into exponent and mantissa in [0.7048, 1.4095)
+constexpr std::uint64_t mantissa_offset = 0x3fe6955500000000;
+constexpr std::uint64_t exponent_bias_bits = 0x3ff0000000000000;
+constexpr std::uint64_t exponent_mask = 0xfff0000000000000;
+// adding it to an integral double below 2^51 leaves the integer biased by 1023 in the low mantissa bits
+constexpr double integer_magic = 0x1p52 + 1023.0;
+
+// one lane wide operations, used on hardware without vector units and for the tails of vector loops
+struct ScalarOps {
+    using V = double;
+    static constexpr std::size_t lanes = 1;
+
+    static V load(const double* p) { return *p; }
+    static void store(double* p, V v) { *p = v; }
+    static V set1(double value) { return value; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static V fma(V a, V b, V c) { return std::fma(a, b, c); }
+    static V round(V a) { return std::nearbyint(a); }
+    static V sqrt(V a) { return std::sqrt(a); }
+    static V abs(V a) { return std::fabs(a); }
+    // the second operand if they are unordered, like the minpd and maxpd instructions
+    static V min(V a, V b) { return a < b ? a : b; }
+    static V max(V a, V b) { return a > b ? a : b; }
+    static bool all_within(V v, double low, double high) { return v >= low && v <= high; }
+    static bool any_equal(V v, double value) { return v == value; }
+
+    // splits a positive normal x into x = 2^exponent * mantissa
+    static void split(V x, V& exponent, V& mantissa) {
+        const std::uint64_t bits = as_bits(x);
+        const std::uint64_t shifted = bits - mantissa_offset + exponent_bias_bits;
+        exponent = as_double((shifted >> 52) | as_bits(0x1p52)) - integer_magic;
+        mantissa = as_double(bits - (shifted & exponent_mask) + exponent_bias_bits);
+    }
+
+    // returns 2^n for an integral n in [-1022, 1023]
+    static V exp2_integer(V n) {
+        return as_double(as_bits(n + integer_magic) << 52);
+    }
+};
+
+// one lane wide single precision operations, for the tails of single precision vector loops
+struct ScalarFloatOps {
+    using V = float;
+    static constexpr std::size_t lanes = 1;
+
+    static V load(const float* p) { return *p; }
+    static void store(float* p, V v) { *p = v; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static bool any_equal(V v, float value) { return v == value; }
+};
+
+// lhs[i] op= rhs[i] for an elementary operation, vector body with scalar tail
+template<typename Ops, typename T, typename VectorOp, typename ScalarOp>
+void elementwise(T* lhs, const T* rhs, std::size_t count, VectorOp vector_op, ScalarOp scalar_op) {
+    std::size_t i = 0;
+    for (; i + Ops::lanes <= count; i += Ops::lanes) {
+        Ops::store(lhs + i, vector_op(Ops::load(lhs + i), Ops::load(rhs + i)));
+    }
+    for (; i < count; ++i) {
+        lhs[i] = scalar_op(lhs[i], rhs[i]);
+    }
+}
+
+template<typename Ops>
+void add_kernel(double* lhs, const double* rhs, std::size_t count) {
+    elementwise<Ops>(lhs, rhs, count, Ops::add, ScalarOps::add);
+}
+
+template<typename Ops>
+void subtract_kernel(double* lhs, const double* rhs, std::size_t count) {
+    elementwise<Ops>(lhs, rhs, count, Ops::sub, ScalarOps::sub);
+}
+
+template<typename Ops>
+void multiply_kernel(double* lhs, const double* rhs, std::size_t count) {
+    elementwise<Ops>(lhs, rhs, count, Ops::mul, ScalarOps::mul);
+}
+
+template<typename Ops>
+void min_kernel(double* lhs, const double* rhs, std::size_t count) {
+    elementwise<Ops>(lhs, rhs, count, Ops::min, ScalarOps::min);
+}
+
+template<typename Ops>
+void max_kernel(double* lhs, const double* rhs, std::size_t count) {
+    elementwise<Ops>(lhs, rhs, count, Ops::max, ScalarOps::max);
+}
+
+// values[i] = op(values[i]), vector body with scalar tail
+template<typename Ops, typename VectorOp, typename ScalarOp>
+void unary(double* values, std::size_t count, VectorOp vector_op, ScalarOp scalar_op) {
+    std::size_t i = 0;
+    for (; i + Ops::lanes <= count; i += Ops::lanes) {
+        Ops::store(values + i, vector_op(Ops::load(values + i)));
+    }
+    for (; i < count; ++i) {
+        values[i] = scalar_op(values[i]);
+    }
+}
+
+template<typename Ops>
+void sqrt_kernel(double* values, std::size_t count) {
+    unary<Ops>(values, count, Ops::sqrt, ScalarOps::sqrt);
+}
+
+template<typename Ops>
+void abs_kernel(double* values, std::size_t count) {
+    unary<Ops>(values, count, Ops::abs, ScalarOps::abs);
+}
+
+template<typename Ops, typename T>
+bool divide_kernel(T* lhs, const T* rhs, std::size_t count) {
+    std::size_t i = 0;
+    for (; i + Ops::lanes <= count; i += Ops::lanes) {
+        const typename Ops::V divisor = Ops::load(rhs + i);
+        if (Ops::any_equal(divisor, T(0))) {
+            return false;
+        }
+        Ops::store(lhs + i, Ops::div(Ops::load(lhs + i), divisor));
+    }
+    for (; i < count; ++i) {
+        if (rhs[i] == T(0)) {
+            return false;
+        }
+        lhs[i] /= rhs[i];
+    }
+    return true;
+}
+
+template<typename FloatOps>
+void add_float_kernel(float* lhs, const float* rhs, std::size_t count) {
+    elementwise<FloatOps>(lhs, rhs, count, FloatOps::add, ScalarFloatOps::add);
+}
+
+template<typename FloatOps>
+void subtract_float_kernel(float* lhs, const float* rhs, std::size_t count) {
+    elementwise<FloatOps>(lhs, rhs, count, FloatOps::sub, ScalarFloatOps::sub);
+}
+
+template<typename FloatOps>
+void multiply_float_kernel(float* lhs, const float* rhs, std::size_t count) {
+    elementwise<FloatOps>(lhs, rhs, count, FloatOps::mul, ScalarFloatOps::mul);
+}
+
+void pow_exact_kernel(double* lhs, const double* rhs, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        lhs[i] = std::pow(lhs[i], rhs[i]);
+    }
+}
+
+// x^y = 2^(y * log2(x)) with log2(x) and the product carried in double-double precision,
+// returns false when some lane is outside of the range where the approximation is valid
+template<typename Ops>
+bool pow_approximate(typename Ops::V x, typename Ops::V y, typename Ops::V& result) {
+    using V = typename Ops::V;
+    constexpr double log2e_hi = 0x1.71547652b82fep0;
+    constexpr double log2e_lo = 0x1.777d0ffda0d24p-56;
+    constexpr double ln2_hi = 0x1.62e42fefa39efp-1;
+    constexpr double ln2_lo = 0x1.abc9e3b39803fp-56;
+    constexpr double two_thirds_hi = 0x1.5555555555555p-1;
+    constexpr double two_thirds_lo = 0x1.5555555555555p-55;
+
+    if (!Ops::all_within(x, std::numeric_limits<double>::min(), std::numeric_limits<double>::max())
+            || !Ops::all_within(y, -std::numeric_limits<double>::max(), std::numeric_limits<double>::max())) {
+        return false;
+    }
+
+    // x = 2^e * m, ln(m) = 2 atanh(s) with s = (m - 1) / (m + 1)
+    V e, m;
+    Ops::split(x, e, m);
+    const V f = Ops::sub(m, Ops::set1(1.0));
+    const V d = Ops::add(Ops::set1(2.0), f);
+    const V d_lo = Ops::add(Ops::sub(Ops::set1(2.0), d), f);
+    const V s = Ops::div(f, d);
+    const V s_lo = Ops::div(Ops::sub(Ops::fma(Ops::sub(Ops::set1(0.0), s), d, f), Ops::mul(s, d_lo)), d);
+
+    // 2 atanh(s) = 2s + 2/3 s^3 + s^5 (2/5 + 2/7 s^2 + ...) with s^2 < 0.029, the s^3 term is the only one
+    // large enough to need double-double precision, the low part ds of s contributes 2 ds (1 + s^2)
+    const V z = Ops::mul(s, s);
+    const V z_lo = Ops::fma(s, s, Ops::sub(Ops::set1(0.0), z));
+    const V cube = Ops::mul(z, s);
+    const V cube_lo = Ops::fma(z_lo, s, Ops::fma(z, s, Ops::sub(Ops::set1(0.0), cube)));
+    const V cubic = Ops::mul(cube, Ops::set1(two_thirds_hi));
+    const V cubic_lo = Ops::fma(cube, Ops::set1(two_thirds_hi), Ops::sub(Ops::set1(0.0), cubic));
+
+    V p = Ops::set1(2.0 / 23.0);
+    p = Ops::fma(p, z, Ops::set1(2.0 / 21.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 19.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 17.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 15.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 13.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 11.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 9.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 7.0));
+    p = Ops::fma(p, z, Ops::set1(2.0 / 5.0));
+
+    V tail = Ops::mul(Ops::mul(cube, z), p);
+    tail = Ops::add(tail, Ops::fma(cube, Ops::set1(two_thirds_lo), Ops::fma(cube_lo, Ops::set1(two_thirds_hi), cubic_lo)));
+    tail = Ops::add(tail, Ops::mul(Ops::add(s_lo, s_lo), Ops::add(Ops::set1(1.0), z)));
+
+    const V twice_s = Ops::add(s, s);
+    const V ln_sum = Ops::add(twice_s, cubic);
+    const V ln_sum_lo = Ops::add(Ops::sub(twice_s, ln_sum), cubic);
+    const V ln_hi = Ops::add(ln_sum, Ops::add(ln_sum_lo, tail));
+    const V ln_lo = Ops::add(Ops::sub(ln_sum, ln_hi), Ops::add(ln_sum_lo, tail));
+
+    // log2(x) = e + ln(m) * log2(e), |e| >= |ln(m) * log2(e)| unless e is zero so the sum is a fast two-sum
+    const V l_hi = Ops::mul(ln_hi, Ops::set1(log2e_hi));
+    const V l_lo = Ops::add(Ops::fma(ln_hi, Ops::set1(log2e_hi), Ops::sub(Ops::set1(0.0), l_hi)),
+                            Ops::fma(ln_hi, Ops::set1(log2e_lo), Ops::mul(ln_lo, Ops::set1(log2e_hi))));
+    const V log_hi = Ops::add(e, l_hi);
+    const V log_lo = Ops::add(Ops::add(Ops::sub(e, log_hi), l_hi), l_lo);
+
+    // t = y * log2(x)
+    const V t_hi = Ops::mul(y, log_hi);
+    const V t_lo = Ops::fma(y, log_lo, Ops::fma(y, log_hi, Ops::sub(Ops::set1(0.0), t_hi)));
+    if (!Ops::all_within(t_hi, -1020.0, 1020.0)) {
+        return false;
+    }
+
+    // 2^t = 2^n * exp(r * ln(2)) with n = round(t) and |r| <= 0.5, t_hi - n is exact
+    const V n = Ops::round(t_hi);
+    const V r = Ops::add(Ops::sub(t_hi, n), t_lo);
+    const V w = Ops::fma(r, Ops::set1(ln2_hi), Ops::mul(r, Ops::set1(ln2_lo)));
+
+    // Taylor series of exp(w) for |w| < 0.347
+    V q = Ops::set1(1.0 / 6227020800.0);
+    q = Ops::fma(q, w, Ops::set1(1.0 / 479001600.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 39916800.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 3628800.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 362880.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 40320.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 5040.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 720.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 120.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 24.0));
+    q = Ops::fma(q, w, Ops::set1(1.0 / 6.0));
+    q = Ops::fma(q, w, Ops::set1(0.5));
+    q = Ops::fma(q, Ops::mul(w, w), w);
+    const V exp_w = Ops::add(Ops::set1(1.0), q);
+
+    result = Ops::mul(exp_w, Ops::exp2_integer(n));
+    return true;
+}
+
+template<typename Ops>
+void pow_approximate_kernel(double* lhs, const double* rhs, std::size_t count) {
+    std::size_t i = 0;
+    for (; i + Ops::lanes <= count; i += Ops::lanes) {
+        typename Ops::V result;
+        if (pow_approximate<Ops>(Ops::load(lhs + i), Ops::load(rhs + i), result)) {
+            Ops::store(lhs + i, result);
+        } else {
+            pow_exact_kernel(lhs + i, rhs + i, Ops::lanes);
+        }
+    }
+    for (; i < count; ++i) {
+        double result;
+        lhs[i] = pow_approximate<ScalarOps>(lhs[i], rhs[i], result) ? result : std::pow(lhs[i], rhs[i]);
+    }
+}
+
+// kernel table for one set of double and one set of single precision vector operations
+template<typename Ops, typename FloatOps>
+constexpr SimdKernels make_kernels(SimdLevel level) {
+    return {
+        level,
+        add_kernel<Ops>,
+        subtract_kernel<Ops>,
+        multiply_kernel<Ops>,
+        divide_kernel<Ops, double>,
+        pow_exact_kernel,
+        pow_approximate_kernel<Ops>,
+        min_kernel<Ops>,
+        max_kernel<Ops>,
+        sqrt_kernel<Ops>,
+        abs_kernel<Ops>,
+        add_float_kernel<FloatOps>,
+        subtract_float_kernel<FloatOps>,
+        multiply_float_kernel<FloatOps>,
+        divide_kernel<FloatOps, float>,
+    };
+}
+
+} // namespace
+
+#endif //SIMD_KERNELS_IMPL_HPP
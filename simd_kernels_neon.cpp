@@ -0,0 +1,73 @@
+// built for AArch64 where Advanced SIMD is always available
+
+#include "simd_kernels_impl.hpp"
+
+#include <arm_neon.h>
+
+namespace {
+
+struct NeonOps {
+    using V = float64x2_t;
+    static constexpr std::size_t lanes = 2;
+
+    static V load(const double* p) { return vld1q_f64(p); }
+    static void store(double* p, V v) { vst1q_f64(p, v); }
+    static V set1(double value) { return vdupq_n_f64(value); }
+    static V add(V a, V b) { return vaddq_f64(a, b); }
+    static V sub(V a, V b) { return vsubq_f64(a, b); }
+    static V mul(V a, V b) { return vmulq_f64(a, b); }
+    static V div(V a, V b) { return vdivq_f64(a, b); }
+    static V fma(V a, V b, V c) { return vfmaq_f64(c, a, b); }
+    static V round(V a) { return vrndnq_f64(a); }
+    static V sqrt(V a) { return vsqrtq_f64(a); }
+    static V abs(V a) { return vabsq_f64(a); }
+    // selected by comparison, vminq_f64 and vmaxq_f64 would return NaN for unordered operands
+    static V min(V a, V b) { return vbslq_f64(vcltq_f64(a, b), a, b); }
+    static V max(V a, V b) { return vbslq_f64(vcgtq_f64(a, b), a, b); }
+
+    static bool all_within(V v, double low, double high) {
+        const uint64x2_t inside = vandq_u64(vcgeq_f64(v, set1(low)), vcleq_f64(v, set1(high)));
+        return vminvq_u32(vreinterpretq_u32_u64(inside)) != 0;
+    }
+
+    static bool any_equal(V v, double value) {
+        return vmaxvq_u32(vreinterpretq_u32_u64(vceqq_f64(v, set1(value)))) != 0;
+    }
+
+    static void split(V x, V& exponent, V& mantissa) {
+        const uint64x2_t bits = vreinterpretq_u64_f64(x);
+        const uint64x2_t shifted = vaddq_u64(vsubq_u64(bits, vdupq_n_u64(mantissa_offset)), vdupq_n_u64(exponent_bias_bits));
+        const uint64x2_t biased = vorrq_u64(vshrq_n_u64(shifted, 52), vdupq_n_u64(as_bits(0x1p52)));
+        exponent = sub(vreinterpretq_f64_u64(biased), set1(integer_magic));
+        mantissa = vreinterpretq_f64_u64(vaddq_u64(vsubq_u64(bits, vandq_u64(shifted, vdupq_n_u64(exponent_mask))),
+                                                   vdupq_n_u64(exponent_bias_bits)));
+    }
+
+    static V exp2_integer(V n) {
+        return vreinterpretq_f64_u64(vshlq_n_u64(vreinterpretq_u64_f64(add(n, set1(integer_magic))), 52));
+    }
+};
+
+struct NeonFloatOps {
+    using V = float32x4_t;
+    static constexpr std::size_t lanes = 4;
+
+    static V load(const float* p) { return vld1q_f32(p); }
+    static void store(float* p, V v) { vst1q_f32(p, v); }
+    static V add(V a, V b) { return vaddq_f32(a, b); }
+    static V sub(V a, V b) { return vsubq_f32(a, b); }
+    static V mul(V a, V b) { return vmulq_f32(a, b); }
+    static V div(V a, V b) { return vdivq_f32(a, b); }
+
+    static bool any_equal(V v, float value) {
+        return vmaxvq_u32(vceqq_f32(v, vdupq_n_f32(value))) != 0;
+    }
+};
+
+constexpr SimdKernels kernels = make_kernels<NeonOps, NeonFloatOps>(SimdLevel::Neon);
+
+} // namespace
+
+const SimdKernels& neon_kernels() {
+    return kernels;
+}
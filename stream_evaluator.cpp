@@ -0,0 +1,269 @@
+#include "stream_evaluator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <string>
+
+BufferedWriter::BufferedWriter(std::FILE* output, std::size_t capacity) : output_(output), buffer_(capacity) {
+}
+
+BufferedWriter::~BufferedWriter() {
+    // errors cannot be reported from a destructor, callers flush explicitly to see them
+    if (size_ > 0) {
+        std::fwrite(buffer_.data(), 1, size_, output_);
+    }
+}
+
+void BufferedWriter::write(std::string_view text) {
+    if (buffer_.size() - size_ < text.size()) {
+        flush();
+        if (text.size() > buffer_.size()) {
+            buffer_.resize(text.size());
+        }
+    }
+    std::memcpy(buffer_.data() + size_, text.data(), text.size());
+    size_ += text.size();
+}
+
+// writes the shortest text that reads back as the same value, like std::format("{}", value)
+void BufferedWriter::write(double value) {
+    // the longest shortest representation of a double, e.g. -2.2250738585072014e-308, is 24 characters
+    constexpr std::size_t max_length = 32;
+    if (buffer_.size() - size_ < max_length) {
+        flush();
+    }
+    const auto result = std::to_chars(buffer_.data() + size_, buffer_.data() + buffer_.size(), value);
+    size_ = static_cast<std::size_t>(result.ptr - buffer_.data());
+}
+
+// writes the buffered text to the output, throws std::runtime_error if it fails
+void BufferedWriter::flush() {
+    if (size_ > 0 && std::fwrite(buffer_.data(), 1, size_, output_) != size_) {
+        size_ = 0;
+        throw std::runtime_error("Failed to write output");
+    }
+    size_ = 0;
+}
+
+namespace {
+
+// appends to a string, the output of one chunk evaluated on a pool thread
+struct TextWriter {
+    std::string& text;
+
+    void write(std::string_view part) { text.append(part); }
+
+    void write(double value) {
+        std::array<char, 32> digits;
+        const auto result = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+        text.append(digits.data(), result.ptr);
+    }
+};
+
+template<typename Writer>
+void evaluate_line(std::string_view line, Writer& writer, StreamStatistics& statistics) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+
+    ++statistics.lines;
+    const auto result = try_evaluate(line);
+    if (result) {
+        writer.write(*result);
+    } else {
+        ++statistics.errors;
+        writer.write("error: ");
+        writer.write(describe(result.error(), line));
+    }
+    writer.write("\n");
+}
+
+// evaluates the complete lines of text and returns the offset after the last one
+template<typename Writer>
+std::size_t evaluate_lines(std::string_view text, Writer& writer, StreamStatistics& statistics) {
+    std::size_t line_start = 0;
+    for (std::size_t end = text.find('\n'); end != std::string_view::npos; end = text.find('\n', line_start)) {
+        evaluate_line(text.substr(line_start, end - line_start), writer, statistics);
+        line_start = end + 1;
+    }
+    return line_start;
+}
+
+// output of one chunk evaluated on the pool
+struct ChunkResult {
+    std::string text;
+    StreamStatistics statistics;
+};
+
+ChunkResult evaluate_chunk(std::string_view chunk, bool last) {
+    ChunkResult result;
+    result.text.reserve(chunk.size());
+    TextWriter writer{result.text};
+    const std::size_t end = evaluate_lines(chunk, writer, result.statistics);
+    // the last line needs no newline
+    if (last && end < chunk.size()) {
+        evaluate_line(chunk.substr(end), writer, result.statistics);
+    }
+    return result;
+}
+
+// evaluates chunks on the pool and writes their output in the order they were submitted,
+// a bounded number of them is evaluated at a time
+class OrderedChunks {
+public:
+    OrderedChunks(ThreadPool& pool, std::FILE* output) : pool_(pool), output_(output), max_in_flight_(2 * pool.size()) {}
+    OrderedChunks(const OrderedChunks&) = delete;
+    OrderedChunks& operator=(const OrderedChunks&) = delete;
+
+    // chunks may view memory of the caller, so they are waited for even when writing failed
+    ~OrderedChunks() {
+        for (const auto& chunk : in_flight_) {
+            chunk.wait();
+        }
+    }
+
+    template<typename Function>
+    void submit(Function&& evaluate) {
+        if (in_flight_.size() == max_in_flight_) {
+            write_oldest();
+        }
+        in_flight_.push_back(pool_.async(std::forward<Function>(evaluate)));
+    }
+
+    // writes the output of all chunks and returns their counts
+    StreamStatistics finish() {
+        while (!in_flight_.empty()) {
+            write_oldest();
+        }
+        if (std::fflush(output_) != 0) {
+            throw std::runtime_error("Failed to write output");
+        }
+        return statistics_;
+    }
+
+private:
+    void write_oldest() {
+        const ChunkResult result = in_flight_.front().get();
+        in_flight_.pop_front();
+        if (std::fwrite(result.text.data(), 1, result.text.size(), output_) != result.text.size()) {
+            throw std::runtime_error("Failed to write output");
+        }
+        statistics_.lines += result.statistics.lines;
+        statistics_.errors += result.statistics.errors;
+    }
+
+    ThreadPool& pool_;
+    std::FILE* output_;
+    std::size_t max_in_flight_;
+    std::deque<std::future<ChunkResult>> in_flight_;
+    StreamStatistics statistics_;
+};
+
+} // namespace
+
+// evaluates every newline-delimited expression of input and writes one line per expression to output
+StreamStatistics evaluate_stream(std::FILE* input, std::FILE* output) {
+    StreamStatistics statistics;
+    BufferedWriter writer(output);
+
+    // a line cut by the end of a chunk is moved to the front and completed by the next read
+    std::vector<char> buffer(stream_chunk_size);
+    std::size_t pending = 0;
+    while (true) {
+        if (pending == buffer.size()) {
+            buffer.resize(buffer.size() * 2); // a single line longer than the buffer
+        }
+        const std::size_t read = std::fread(buffer.data() + pending, 1, buffer.size() - pending, input);
+        if (read == 0) {
+            break;
+        }
+
+        const std::string_view chunk(buffer.data(), pending + read);
+        const std::size_t line_start = evaluate_lines(chunk, writer, statistics);
+        pending = chunk.size() - line_start;
+        std::memmove(buffer.data(), buffer.data() + line_start, pending);
+    }
+
+    if (std::ferror(input)) {
+        throw std::runtime_error("Failed to read input");
+    }
+    // the last line needs no newline
+    if (pending > 0) {
+        evaluate_line(std::string_view(buffer.data(), pending), writer, statistics);
+    }
+    writer.flush();
+    return statistics;
+}
+
+// evaluates chunks of whole lines on the pool and writes their output in input order
+StreamStatistics evaluate_stream(std::FILE* input, std::FILE* output, ThreadPool& pool) {
+    OrderedChunks chunks(pool, output);
+    const auto submit = [&](std::string chunk, bool last) {
+        chunks.submit([chunk = std::move(chunk), last] { return evaluate_chunk(chunk, last); });
+    };
+
+    // each chunk ends at its last newline, the line cut by the end of a read starts the next chunk
+    std::string pending;
+    while (true) {
+        std::string chunk = std::move(pending);
+        const std::size_t start = chunk.size();
+        chunk.resize(std::max(parallel_chunk_size, 2 * start)); // a single line longer than a chunk
+        const std::size_t read = std::fread(chunk.data() + start, 1, chunk.size() - start, input);
+        chunk.resize(start + read);
+        if (read == 0) {
+            pending = std::move(chunk);
+            break;
+        }
+
+        const std::size_t end = chunk.rfind('\n');
+        if (end == std::string::npos) {
+            pending = std::move(chunk);
+            continue;
+        }
+        pending.assign(chunk, end + 1);
+        chunk.resize(end + 1);
+        submit(std::move(chunk), false);
+    }
+
+    if (std::ferror(input)) {
+        throw std::runtime_error("Failed to read input");
+    }
+    if (!pending.empty()) {
+        submit(std::move(pending), true);
+    }
+    return chunks.finish();
+}
+
+// evaluates every newline-delimited expression of text and writes one line per expression to output
+StreamStatistics evaluate_text(std::string_view text, std::FILE* output) {
+    StreamStatistics statistics;
+    BufferedWriter writer(output);
+    const std::size_t end = evaluate_lines(text, writer, statistics);
+    // the last line needs no newline
+    if (end < text.size()) {
+        evaluate_line(text.substr(end), writer, statistics);
+    }
+    writer.flush();
+    return statistics;
+}
+
+// evaluates chunks of whole lines of text on the pool and writes their output in input order
+StreamStatistics evaluate_text(std::string_view text, std::FILE* output, ThreadPool& pool) {
+    OrderedChunks chunks(pool, output);
+    // chunks are views into text, which outlives them since finish() waits for all of them
+    while (!text.empty()) {
+        std::size_t end = text.size();
+        if (end > parallel_chunk_size) {
+            const std::size_t newline = text.find('\n', parallel_chunk_size - 1);
+            end = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        const std::string_view chunk = text.substr(0, end);
+        text.remove_prefix(end);
+        chunks.submit([chunk, last = text.empty()] { return evaluate_chunk(chunk, last); });
+    }
+    return chunks.finish();
+}
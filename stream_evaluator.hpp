@@ -0,0 +1,58 @@
+#ifndef STREAM_EVALUATOR_HPP
+#define STREAM_EVALUATOR_HPP
+
+#include "expression_evaluator.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdio>
+
+// bytes read from the input and collected for the output at once
+constexpr std::size_t stream_chunk_size = 1 << 20;
+
+// bytes of input evaluated by one pool task, small enough to keep every thread busy
+constexpr std::size_t parallel_chunk_size = 1 << 18;
+
+// counts of a stream evaluation
+struct StreamStatistics {
+    std::size_t lines = 0;
+    std::size_t errors = 0;
+};
+
+// output buffer written in large blocks, numbers are formatted with std::to_chars
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::FILE* output, std::size_t capacity = stream_chunk_size);
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+    ~BufferedWriter();
+
+    void write(std::string_view text);
+
+    // writes the shortest text that reads back as the same value, like std::format("{}", value)
+    void write(double value);
+
+    // writes the buffered text to the output, throws std::runtime_error if it fails
+    void flush();
+
+private:
+    std::FILE* output_;
+    std::vector<char> buffer_;
+    std::size_t size_ = 0;
+};
+
+// evaluates every newline-delimited expression of input and writes one line per expression to output,
+// the result or "error: " followed by the description, malformed lines do not stop the stream;
+// input is read in chunks and lines are evaluated in place without being copied
+StreamStatistics evaluate_stream(std::FILE* input, std::FILE* output);
+
+// like evaluate_stream but evaluates chunks of whole lines on the pool, the output is written in input order
+// and is identical to the single-threaded one
+StreamStatistics evaluate_stream(std::FILE* input, std::FILE* output, ThreadPool& pool);
+
+// like evaluate_stream for input that is already in memory, e.g. a MappedFile, lines are evaluated in place
+StreamStatistics evaluate_text(std::string_view text, std::FILE* output);
+
+// like evaluate_text but evaluates chunks of whole lines on the pool, the output is written in input order
+StreamStatistics evaluate_text(std::string_view text, std::FILE* output, ThreadPool& pool);
+
+#endif //STREAM_EVALUATOR_HPP
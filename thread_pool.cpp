@@ -0,0 +1,99 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// pool and queue index of the worker running on the current thread
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_queue = 0;
+
+} // namespace
+
+// starts threads workers, by default one per hardware thread
+ThreadPool::ThreadPool(std::size_t threads) : queues_(std::max<std::size_t>(threads, 1)) {
+    workers_.reserve(queues_.size());
+    for (std::size_t i = 0; i < queues_.size(); ++i) {
+        workers_.emplace_back([this, i] { run(i); });
+    }
+}
+
+// runs the tasks still queued, then joins the workers
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    workers_.clear();
+}
+
+// number of hardware threads, at least one
+std::size_t ThreadPool::default_thread_count() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// queues a task, tasks submitted from a worker go to its own queue, others are spread round robin, the wake
+// mutex is only taken if a worker may be sleeping
+void ThreadPool::submit(Task task) {
+    const std::size_t index = current_pool == this ? current_queue : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard lock(queues_[index].mutex);
+        queues_[index].tasks.push_back(std::move(task));
+    }
+    // sequentially consistent with the sleepers_ increment in run(), so either this sees the sleeper or the
+    // sleeper sees the task
+    pending_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+        // taking the mutex orders the notification after a sleeper checked pending_ and before it missed it
+        { std::lock_guard lock(wake_mutex_); }
+        wake_.notify_one();
+    }
+}
+
+void ThreadPool::run(std::size_t index) {
+    current_pool = this;
+    current_queue = index;
+
+    Task task;
+    while (true) {
+        if (try_pop(index, task)) {
+            pending_.fetch_sub(1);
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        sleepers_.fetch_add(1);
+        std::unique_lock lock(wake_mutex_);
+        wake_.wait(lock, [this] { return pending_.load() > 0 || stopping_; });
+        sleepers_.fetch_sub(1);
+        if (stopping_ && pending_.load() <= 0) {
+            return;
+        }
+    }
+}
+
+// pops the newest task of the worker's own queue or steals the oldest one of another queue
+bool ThreadPool::try_pop(std::size_t index, Task& task) {
+    {
+        Queue& own = queues_[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+        Queue& other = queues_[(index + offset) % queues_.size()];
+        std::lock_guard lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
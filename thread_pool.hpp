@@ -0,0 +1,71 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed set of worker threads, each with its own task queue, workers run their own tasks newest first
+// and steal the oldest tasks of other workers once their queue is empty
+class ThreadPool {
+public:
+    using Task = std::move_only_function<void()>;
+
+    // starts threads workers, by default one per hardware thread
+    explicit ThreadPool(std::size_t threads = default_thread_count());
+
+    // runs the tasks still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of hardware threads, at least one
+    static std::size_t default_thread_count();
+
+    std::size_t size() const { return workers_.size(); }
+
+    // queues a task, tasks submitted from a worker go to its own queue, others are spread round robin,
+    // the task must not throw
+    void submit(Task task);
+
+    // queues a function and returns a future of its result or exception
+    template<typename Function>
+    std::future<std::invoke_result_t<Function>> async(Function&& function) {
+        std::packaged_task<std::invoke_result_t<Function>()> task(std::forward<Function>(function));
+        auto future = task.get_future();
+        submit(std::move(task));
+        return future;
+    }
+
+private:
+    // queue of one worker, aligned so workers do not share cache lines
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(std::size_t index);
+
+    // pops the newest task of the worker's own queue or steals the oldest one of another queue
+    bool try_pop(std::size_t index, Task& task);
+
+    std::vector<Queue> queues_;
+    // queued tasks not yet taken by a worker, counted after the push and uncounted after the pop, so it may
+    // briefly be one off in either direction
+    std::atomic<std::ptrdiff_t> pending_ = 0;
+    std::atomic<std::size_t> sleepers_ = 0; // workers about to wait or waiting for a task
+    std::atomic<std::size_t> next_queue_ = 0; // round robin position of submissions from outside the pool
+    std::mutex wake_mutex_; // only taken to sleep and to wake sleepers
+    std::condition_variable wake_;
+    bool stopping_ = false; // guarded by wake_mutex_
+    std::vector<std::jthread> workers_;
+};
+
+#endif //THREAD_POOL_HPP
@@ -0,0 +1,250 @@
+#include "typed_expression.hpp"
+#include "batch_evaluator.hpp"
+#include "simd_kernels.hpp"
+
+namespace {
+
+// returns the first constant of a program that is not representable as Value
+template<typename Value>
+std::optional<EvalErrorCode> unrepresentable_constant(std::span<const Instruction> program) {
+    for (const Instruction& instruction : program) {
+        if (instruction.type != Instruction::Type::Number) {
+            continue;
+        }
+        if (const auto constant = NumericTraits<Value>::from_double(instruction.value); !constant) {
+            return constant.error();
+        }
+    }
+    return std::nullopt;
+}
+
+// vector kernels of the running CPU for each floating point type
+template<typename Value>
+struct BlockKernels;
+
+template<>
+struct BlockKernels<float> {
+    static constexpr auto add = &SimdKernels::add_float;
+    static constexpr auto subtract = &SimdKernels::subtract_float;
+    static constexpr auto multiply = &SimdKernels::multiply_float;
+    static constexpr auto divide = &SimdKernels::divide_float;
+};
+
+template<>
+struct BlockKernels<double> {
+    static constexpr auto add = &SimdKernels::add;
+    static constexpr auto subtract = &SimdKernels::subtract;
+    static constexpr auto multiply = &SimdKernels::multiply;
+    static constexpr auto divide = &SimdKernels::divide;
+};
+
+// applies an operator element-wise on a block of rows, storing the results in lhs, floating point blocks run
+// on the vector kernels, fixed point ones check every row
+template<typename Value>
+std::expected<void, EvalErrorCode> apply_block(Operator op, Value* lhs, const Value* rhs, std::size_t count) {
+    if constexpr (std::is_floating_point_v<Value>) {
+        const SimdKernels& kernels = simd_kernels();
+        switch (op) {
+            case Operator::Addition:
+                (kernels.*BlockKernels<Value>::add)(lhs, rhs, count);
+                return {};
+            case Operator::Subtraction:
+                (kernels.*BlockKernels<Value>::subtract)(lhs, rhs, count);
+                return {};
+            case Operator::Multiplication:
+                (kernels.*BlockKernels<Value>::multiply)(lhs, rhs, count);
+                return {};
+            case Operator::Division:
+                if (!(kernels.*BlockKernels<Value>::divide)(lhs, rhs, count)) {
+                    return std::unexpected(EvalErrorCode::DivisionByZero);
+                }
+                return {};
+            case Operator::Exponentiation:
+                for (std::size_t i = 0; i < count; ++i) {
+                    lhs[i] = std::pow(lhs[i], rhs[i]);
+                }
+                return {};
+        }
+        throw std::runtime_error("Invalid Operator enum value");
+    } else {
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto result = NumericTraits<Value>::apply(op, lhs[i], rhs[i]);
+            if (!result) {
+                return std::unexpected(result.error());
+            }
+            lhs[i] = *result;
+        }
+        return {};
+    }
+}
+
+// applies a function on a block of rows, arguments are the blocks starting at arguments, only double blocks
+// use the block version of a function, other types are converted per row
+template<typename Value>
+std::expected<void, EvalErrorCode> apply_function_block(const FunctionDefinition& function, Value* arguments, std::size_t count) {
+    if constexpr (std::is_same_v<Value, double>) {
+        if (function.batch != nullptr) {
+            function.batch(arguments, batch_block_size, count);
+            return {};
+        }
+    }
+    std::array<Value, max_function_arity> row{};
+    for (std::size_t i = 0; i < count; ++i) {
+        for (std::size_t k = 0; k < function.arity; ++k) {
+            row[k] = arguments[k * batch_block_size + i];
+        }
+        const auto result = call_function(function, row.data());
+        if (!result) {
+            return std::unexpected(result.error());
+        }
+        arguments[i] = *result;
+    }
+    return {};
+}
+
+// runs instructions on one block of count rows starting at first_row, block operands are batch_block_size apart
+// on the stack, the result is left in the first block
+template<typename Value>
+std::expected<void, EvalErrorCode> run_block(std::span<const Instruction> program, std::span<const Value* const> columns,
+                                             std::span<const Value> constants, std::size_t first_row, std::size_t count, Value* stack) {
+    std::size_t top = 0;
+    std::size_t constant = 0;
+    std::expected<void, EvalErrorCode> applied;
+    for (const Instruction& instruction : program) {
+        switch (instruction.type) {
+            case Instruction::Type::Number:
+                std::fill_n(&stack[top++ * batch_block_size], count, constants[constant++]);
+                break;
+            case Instruction::Type::Variable:
+                std::copy_n(columns[instruction.slot] + first_row, count, &stack[top++ * batch_block_size]);
+                break;
+            case Instruction::Type::Operator:
+                --top;
+                applied = apply_block(instruction.op, &stack[(top - 1) * batch_block_size], &stack[top * batch_block_size], count);
+                break;
+            case Instruction::Type::Call: {
+                const FunctionDefinition& function = function_definition(instruction.slot);
+                top -= function.arity;
+                applied = apply_function_block(function, &stack[top++ * batch_block_size], count);
+                break;
+            }
+            case Instruction::Type::Store:
+                std::copy_n(&stack[(top - 1) * batch_block_size], count, &stack[instruction.slot * batch_block_size]);
+                break;
+            case Instruction::Type::Load:
+                std::copy_n(&stack[instruction.slot * batch_block_size], count, &stack[top++ * batch_block_size]);
+                break;
+        }
+        if (!applied) {
+            return applied;
+        }
+    }
+    return {};
+}
+
+} // namespace
+
+template<typename Value>
+TypedExpression<Value>::TypedExpression(const CompiledExpression& expression)
+        : TypedExpression(expression, BasicRegisterProgram<Value>::compile(expression.program(), expression.max_stack_depth())) {
+    if (const auto error = unrepresentable_constant<Value>(program_)) {
+        throw EvaluationError({*error});
+    }
+}
+
+template<typename Value>
+TypedExpression<Value>::TypedExpression(const CompiledExpression& expression, std::shared_ptr<const BasicRegisterProgram<Value>> register_program)
+        : program_(expression.program()), variables_(expression.variables()), max_stack_depth_(expression.max_stack_depth()),
+          register_program_(std::move(register_program)) {
+}
+
+// converts a compiled program, returns an error if a constant is not representable as Value
+template<typename Value>
+std::expected<TypedExpression<Value>, EvalError> TypedExpression<Value>::create(const CompiledExpression& expression) {
+    if (const auto error = unrepresentable_constant<Value>(expression.program())) {
+        return std::unexpected(EvalError{*error});
+    }
+    return TypedExpression(expression, BasicRegisterProgram<Value>::compile(expression.program(), expression.max_stack_depth()));
+}
+
+// evaluates the program with bindings[slot] as the value of each variable
+template<typename Value>
+Value TypedExpression<Value>::eval(std::span<const Value> bindings) const {
+    const auto result = try_eval(bindings);
+    if (!result) {
+        throw EvaluationError(result.error());
+    }
+    return *result;
+}
+
+// evaluates the program on a per thread register file that only grows
+template<typename Value>
+std::expected<Value, EvalError> TypedExpression<Value>::try_eval(std::span<const Value> bindings) const {
+    if (bindings.size() < variables_.size()) {
+        return std::unexpected(EvalError{EvalErrorCode::NotEnoughBindings});
+    }
+    record(Metric::Evaluations);
+
+    thread_local std::vector<Value> stack;
+    if (stack.size() < max_stack_depth_) {
+        stack.resize(max_stack_depth_);
+    }
+    if (register_program_) {
+        return register_program_->run(bindings, stack.data());
+    }
+    return run_program(program_, bindings, stack.data());
+}
+
+template<typename Value>
+std::size_t TypedExpression<Value>::slot(std::string_view name) const {
+    const auto it = std::find(variables_.begin(), variables_.end(), name);
+    if (it == variables_.end()) {
+        throw std::runtime_error("Unknown variable: " + std::string(name));
+    }
+    return static_cast<std::size_t>(it - variables_.begin());
+}
+
+// evaluates a typed expression once per row of the output column, one block of rows at a time
+template<typename Value>
+void evaluate_batch(const TypedExpression<Value>& expression, std::span<const std::type_identity_t<Value>* const> columns,
+                    std::span<std::type_identity_t<Value>> output) {
+    if (columns.size() < expression.variables().size()) {
+        throw EvaluationError({EvalErrorCode::NotEnoughBindings});
+    }
+    record(Metric::Evaluations);
+    record(Metric::BatchRows, output.size());
+    record_max(Metric::MaxStackDepth, expression.max_stack_depth());
+    const PhaseTimer timer(Metric::EvaluateNanoseconds);
+
+    // constants are converted once per batch instead of once per block
+    thread_local std::vector<Value> constants;
+    constants.clear();
+    for (const Instruction& instruction : expression.program()) {
+        if (instruction.type == Instruction::Type::Number) {
+            constants.push_back(*NumericTraits<Value>::from_double(instruction.value));
+        }
+    }
+
+    // every stack entry holds a whole block of rows, the per thread stack only grows
+    thread_local std::vector<Value> stack;
+    if (stack.size() < expression.max_stack_depth() * batch_block_size) {
+        stack.resize(expression.max_stack_depth() * batch_block_size);
+    }
+
+    for (std::size_t first_row = 0; first_row < output.size(); first_row += batch_block_size) {
+        const std::size_t count = std::min(batch_block_size, output.size() - first_row);
+        if (const auto result = run_block<Value>(expression.program(), columns, constants, first_row, count, stack.data()); !result) {
+            throw EvaluationError({result.error()});
+        }
+        std::copy_n(stack.begin(), count, output.begin() + static_cast<std::ptrdiff_t>(first_row));
+    }
+}
+
+template class TypedExpression<float>;
+template class TypedExpression<double>;
+template void evaluate_batch(const TypedExpression<float>&, std::span<const float* const>, std::span<float>);
+template void evaluate_batch(const TypedExpression<double>&, std::span<const double* const>, std::span<double>);
+#ifdef EXPRESSION_EVALUATOR_HAVE_FIXED_POINT
+template class TypedExpression<Fixed64>;
+template void evaluate_batch(const TypedExpression<Fixed64>&, std::span<const Fixed64* const>, std::span<Fixed64>);
+#endif
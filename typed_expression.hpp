@@ -0,0 +1,86 @@
+#ifndef TYPED_EXPRESSION_HPP
+#define TYPED_EXPRESSION_HPP
+
+#include "expression_evaluator.hpp"
+#include "fixed_point.hpp"
+#include "register_vm.hpp"
+
+// compiled expression evaluated in a value type of its own, e.g. float for half the memory traffic of a
+// batch or Fixed64 for exact decimal sums, constants are parsed as doubles and converted once, and constant
+// operations are left unfolded so every operation rounds like Value
+//
+// runs the register bytecode instantiated for Value, there is no native code tier, immutable after
+// construction, so one instance may be evaluated from any number of threads at once
+template<typename Value>
+class TypedExpression {
+public:
+    // converts a compiled program, throws EvaluationError if a constant is not representable as Value
+    explicit TypedExpression(const CompiledExpression& expression);
+
+    // converts a compiled program, returns an error if a constant is not representable as Value
+    static std::expected<TypedExpression, EvalError> create(const CompiledExpression& expression);
+
+    // evaluates the program with bindings[slot] as the value of each variable
+    Value eval(std::span<const Value> bindings = {}) const;
+
+    // evaluates the program without throwing
+    std::expected<Value, EvalError> try_eval(std::span<const Value> bindings = {}) const;
+
+    // returns the slot index of a variable, throws if the expression does not use it
+    std::size_t slot(std::string_view name) const;
+
+    const std::vector<Instruction>& program() const { return program_; }
+    const std::vector<std::string>& variables() const { return variables_; }
+    std::size_t max_stack_depth() const { return max_stack_depth_; }
+
+    // bytecode run by eval(), nullptr for programs too large to encode, which run on the stack interpreter
+    const BasicRegisterProgram<Value>* register_program() const { return register_program_.get(); }
+
+private:
+    TypedExpression(const CompiledExpression& expression, std::shared_ptr<const BasicRegisterProgram<Value>> register_program);
+
+    std::vector<Instruction> program_;
+    std::vector<std::string> variables_;
+    std::size_t max_stack_depth_ = 0;
+    std::shared_ptr<const BasicRegisterProgram<Value>> register_program_;
+};
+
+// evaluates a typed expression once per row of the output column in blocks of batch_block_size rows,
+// columns[slot] points at one contiguous array of values per variable with at least output.size() rows,
+// floating point blocks run on the SIMD kernels of the running CPU, float fits twice the lanes of double
+template<typename Value>
+void evaluate_batch(const TypedExpression<Value>& expression, std::span<const std::type_identity_t<Value>* const> columns,
+                    std::span<std::type_identity_t<Value>> output);
+
+extern template class TypedExpression<float>;
+extern template class TypedExpression<double>;
+extern template void evaluate_batch(const TypedExpression<float>&, std::span<const float* const>, std::span<float>);
+extern template void evaluate_batch(const TypedExpression<double>&, std::span<const double* const>, std::span<double>);
+#ifdef EXPRESSION_EVALUATOR_HAVE_FIXED_POINT
+extern template class TypedExpression<Fixed64>;
+extern template void evaluate_batch(const TypedExpression<Fixed64>&, std::span<const Fixed64* const>, std::span<Fixed64>);
+#endif
+
+// compiles an expression for evaluation in Value without throwing, variables missing from the given list
+// are either appended or rejected
+template<typename Value>
+std::expected<TypedExpression<Value>, EvalError> try_compile_as(std::string_view expression, std::span<const std::string> variables = {},
+                                                                bool add_unknown_variables = true) {
+    const auto compiled = try_compile(expression, variables, add_unknown_variables, std::is_same_v<Value, double>);
+    if (!compiled) {
+        return std::unexpected(compiled.error());
+    }
+    return TypedExpression<Value>::create(*compiled);
+}
+
+// compiles an expression for evaluation in Value, e.g. compile_as<float>("x*0,5"), throws EvaluationError if it is malformed
+template<typename Value>
+TypedExpression<Value> compile_as(std::string_view expression, std::span<const std::string> variables = {}, bool add_unknown_variables = true) {
+    auto typed = try_compile_as<Value>(expression, variables, add_unknown_variables);
+    if (!typed) {
+        throw EvaluationError(typed.error(), expression);
+    }
+    return std::move(*typed);
+}
+
+#endif //TYPED_EXPRESSION_HPP